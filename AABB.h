@@ -0,0 +1,75 @@
+//
+// Created by alex on 3/14/25.
+//
+
+// AABB.h
+#ifndef AABB_H
+#define AABB_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <limits>
+
+// Axis-aligned bounding box.
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // An empty box, so expanding it by anything yields that thing.
+    AABB()
+        : min(std::numeric_limits<float>::infinity()), max(-std::numeric_limits<float>::infinity()) {}
+
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    void expand(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 centroid() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extent() const {
+        return max - min;
+    }
+
+    bool isEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    // Longest axis, 0 = x, 1 = y, 2 = z.
+    int maxExtentAxis() const {
+        glm::vec3 e = extent();
+        if (e.x > e.y && e.x > e.z)
+            return 0;
+        return e.y > e.z ? 1 : 2;
+    }
+
+    float surfaceArea() const {
+        if (isEmpty())
+            return 0.0f;
+        glm::vec3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Slab test against a ray given its precomputed inverse direction.
+    // On a hit, tNear holds the entry distance (clamped to tMin).
+    bool intersect(const glm::vec3& origin, const glm::vec3& invDir,
+                   float tMin, float tMax, float& tNear) const {
+        glm::vec3 t0 = (min - origin) * invDir;
+        glm::vec3 t1 = (max - origin) * invDir;
+        glm::vec3 tSmall = glm::min(t0, t1);
+        glm::vec3 tBig = glm::max(t0, t1);
+        tNear = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, tMin));
+        float tFar = std::min(std::min(tBig.x, tBig.y), std::min(tBig.z, tMax));
+        return tNear <= tFar;
+    }
+};
+
+#endif // AABB_H
@@ -0,0 +1,57 @@
+//
+// Created by alex on 3/27/25.
+//
+
+// AliasTable.cpp
+#include "AliasTable.h"
+#include <algorithm>
+
+AliasTable::AliasTable(const std::vector<float>& weights) {
+    double total = 0.0;
+    for (float weight : weights)
+        total += std::max(0.0f, weight);
+    if (total <= 0.0)
+        return;
+
+    const size_t n = weights.size();
+    bins.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; i++) {
+        bins[i].pmf = static_cast<float>(std::max(0.0f, weights[i]) / total);
+        scaled[i] = std::max(0.0f, weights[i]) / total * n;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+
+    // Fill each underfull bin with mass from an overfull one.
+    while (!small.empty() && !large.empty()) {
+        uint32_t under = small.back();
+        small.pop_back();
+        uint32_t over = large.back();
+        large.pop_back();
+
+        bins[under].probability = static_cast<float>(scaled[under]);
+        bins[under].alias = over;
+        scaled[over] -= 1.0 - scaled[under];
+        (scaled[over] < 1.0 ? small : large).push_back(over);
+    }
+    // Whatever is left is full up to rounding error.
+    for (uint32_t i : small) {
+        bins[i].probability = 1.0f;
+        bins[i].alias = i;
+    }
+    for (uint32_t i : large) {
+        bins[i].probability = 1.0f;
+        bins[i].alias = i;
+    }
+}
+
+uint32_t AliasTable::sample(float u, float& pmf) const {
+    float scaled = u * static_cast<float>(bins.size());
+    uint32_t index = std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(bins.size() - 1));
+    float remainder = scaled - static_cast<float>(index);
+    if (remainder >= bins[index].probability)
+        index = bins[index].alias;
+    pmf = bins[index].pmf;
+    return index;
+}
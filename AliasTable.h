@@ -0,0 +1,42 @@
+//
+// Created by alex on 3/27/25.
+//
+
+// AliasTable.h
+#ifndef ALIASTABLE_H
+#define ALIASTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Discrete distribution sampled in constant time with Walker's alias method (built with
+// Vose's algorithm). Every bin holds its own outcome with some probability and one
+// alias outcome otherwise, so a sample is one lookup and one comparison.
+class AliasTable {
+public:
+    AliasTable() = default;
+
+    // Weights need not be normalized. Empty if they are all zero.
+    explicit AliasTable(const std::vector<float>& weights);
+
+    bool empty() const { return bins.empty(); }
+    size_t size() const { return bins.size(); }
+
+    // Picks an outcome with u in [0, 1) and sets pmf to its probability. The table
+    // must not be empty.
+    uint32_t sample(float u, float& pmf) const;
+
+    float pmf(uint32_t index) const { return index < bins.size() ? bins[index].pmf : 0.0f; }
+
+private:
+    struct Bin {
+        float probability = 0.0f;   // Chance of keeping this bin's own outcome.
+        uint32_t alias = 0;
+        float pmf = 0.0f;           // Normalized weight of this bin's own outcome.
+    };
+
+    std::vector<Bin> bins;
+};
+
+#endif // ALIASTABLE_H
@@ -7,19 +7,43 @@
 #define BSDF_H
 
 #include "SpectralData.h"
+#include "Sampler.h"
 #include <glm/glm.hpp>
 
+// Result of importance sampling a BSDF. weight is f * cos(theta) / pdf for the sampled
+// direction, which is exactly what the path throughput is multiplied by.
+template <typename SpectrumType>
+struct BSDFSampleOf {
+    glm::vec3 direction = glm::vec3(0.0f);
+    SpectrumType weight = SpectrumType(0.0f);
+    float pdf = 0.0f;   // Solid angle density; 0 if no direction could be sampled.
+};
+
+using BSDFSample = BSDFSampleOf<Spectrum>;
+using SampledBSDFSample = BSDFSampleOf<SampledSpectrum>;   // Weight at the bins of a SampledWavelengths.
+
 class BSDF {
 public:
     virtual ~BSDF() = default;
 
     // Evaluate the BSDF for given incoming (wi) and outgoing (wo) directions.
-    // normal is the surface normal at the hit point.
+    // normal is the surface normal at the hit point. The cosine term is not included.
     virtual Spectrum evaluate(const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal) const = 0;
 
-    // Sample an outgoing direction (wo) given an incoming direction (wi) and surface normal.
-    // Returns the sampled direction and sets pdf to the probability density.
-    virtual glm::vec3 sample(const glm::vec3& wi, const glm::vec3& normal, float& pdf) const = 0;
+    // Same as evaluate, at the bins of a hero-wavelength sample only.
+    virtual SampledSpectrum evaluate(const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal,
+                                     const SampledWavelengths& wavelengths) const = 0;
+
+    // Solid angle density with which sample() picks wo.
+    virtual float pdf(const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal) const = 0;
+
+    // Sample an outgoing direction given an incoming direction (wi) and surface normal.
+    virtual BSDFSample sample(const glm::vec3& wi, const glm::vec3& normal, Sampler& sampler) const = 0;
+
+    // Same as sample, with the weight at the bins of a hero-wavelength sample only. Draws
+    // the same random numbers, so both overloads pick the same direction.
+    virtual SampledBSDFSample sample(const glm::vec3& wi, const glm::vec3& normal,
+                                     const SampledWavelengths& wavelengths, Sampler& sampler) const = 0;
 };
 
 #endif // BSDF_H
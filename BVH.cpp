@@ -0,0 +1,826 @@
+//
+// Created by alex on 3/14/25.
+//
+
+// BVH.cpp
+#include "BVH.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <limits>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct BuildPrim {
+    AABB bounds;
+    glm::vec3 centroid;
+    uint32_t index;
+    uint8_t type;
+};
+
+// Temporary node used while building; flattened into BVH::nodes afterwards.
+struct BuildNode {
+    AABB bounds;
+    std::unique_ptr<BuildNode> children[2];
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint8_t axis = 0;
+    uint8_t type = 0;
+    uint32_t spine = 1;   // Fewest nodes on a path down to a leaf; set for subtree rebuilds.
+};
+
+struct Bin {
+    AABB bounds;
+    uint32_t count = 0;
+};
+
+int binIndex(float centroid, float cmin, float scale) {
+    int b = static_cast<int>((centroid - cmin) * scale);
+    return std::clamp(b, 0, BVH::BIN_COUNT - 1);
+}
+
+std::unique_ptr<BuildNode> buildRecursive(BuildPrim* prims, uint32_t first, uint32_t count, uint32_t depth) {
+    auto node = std::make_unique<BuildNode>();
+
+    AABB centroidBounds;
+    bool mixedTypes = false;
+    for (uint32_t i = first; i < first + count; i++) {
+        node->bounds.expand(prims[i].bounds);
+        centroidBounds.expand(prims[i].centroid);
+        mixedTypes |= prims[i].type != prims[first].type;
+    }
+
+    node->first = first;
+    node->count = count;
+    node->type = prims[first].type;
+    if (count == 1)
+        return node;
+
+    // Find the cheapest binned split over all three axes. Past SAH_DEPTH_LIMIT there is
+    // no search and the range is halved below, so degenerate inputs cannot outgrow MAX_DEPTH.
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestAxis = -1;
+    int bestBin = 0;
+    glm::vec3 cext = centroidBounds.extent();
+
+    for (int axis = 0; axis < 3 && depth < BVH::SAH_DEPTH_LIMIT; axis++) {
+        if (cext[axis] <= 0.0f)
+            continue;
+
+        Bin bins[BVH::BIN_COUNT];
+        float cmin = centroidBounds.min[axis];
+        float scale = BVH::BIN_COUNT / cext[axis];
+        for (uint32_t i = first; i < first + count; i++) {
+            Bin& bin = bins[binIndex(prims[i].centroid[axis], cmin, scale)];
+            bin.count++;
+            bin.bounds.expand(prims[i].bounds);
+        }
+
+        // Sweep from the right to get the cost of every right-hand side, then from the left.
+        float rightArea[BVH::BIN_COUNT - 1];
+        uint32_t rightCount[BVH::BIN_COUNT - 1];
+        AABB acc;
+        uint32_t n = 0;
+        for (int b = BVH::BIN_COUNT - 1; b > 0; b--) {
+            acc.expand(bins[b].bounds);
+            n += bins[b].count;
+            rightArea[b - 1] = acc.surfaceArea();
+            rightCount[b - 1] = n;
+        }
+
+        acc = AABB();
+        n = 0;
+        for (int b = 0; b < BVH::BIN_COUNT - 1; b++) {
+            acc.expand(bins[b].bounds);
+            n += bins[b].count;
+            if (n == 0 || rightCount[b] == 0)
+                continue;
+            float cost = acc.surfaceArea() * BVH::leafGroups(n) + rightArea[b] * BVH::leafGroups(rightCount[b]);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    float area = node->bounds.surfaceArea();
+    float leafCost = BVH::INTERSECTION_COST * BVH::leafGroups(count);
+    float splitCost = BVH::TRAVERSAL_COST + BVH::INTERSECTION_COST * bestCost / area;
+
+    bool makeLeaf = bestAxis < 0 || (splitCost >= leafCost && count <= BVH::MAX_LEAF_SIZE);
+
+    uint32_t mid;
+    if (makeLeaf && mixedTypes) {
+        // A leaf has to be a single pool range, so separate the primitive types instead.
+        uint8_t type = prims[first].type;
+        BuildPrim* split = std::partition(prims + first, prims + first + count,
+            [&](const BuildPrim& p) { return p.type == type; });
+        mid = static_cast<uint32_t>(split - prims);
+        bestAxis = node->bounds.maxExtentAxis();
+    } else if (makeLeaf && count <= BVH::MAX_LEAF_SIZE) {
+        return node;
+    } else if (bestAxis < 0) {
+        // All centroids coincide or the range is too deep for SAH: split at the median.
+        bestAxis = centroidBounds.maxExtentAxis();
+        mid = first + count / 2;
+        std::nth_element(prims + first, prims + mid, prims + first + count,
+            [&](const BuildPrim& a, const BuildPrim& b) { return a.centroid[bestAxis] < b.centroid[bestAxis]; });
+    } else {
+        float cmin = centroidBounds.min[bestAxis];
+        float scale = BVH::BIN_COUNT / cext[bestAxis];
+        BuildPrim* split = std::partition(prims + first, prims + first + count,
+            [&](const BuildPrim& p) { return binIndex(p.centroid[bestAxis], cmin, scale) <= bestBin; });
+        mid = static_cast<uint32_t>(split - prims);
+    }
+
+    node->axis = static_cast<uint8_t>(bestAxis);
+    node->count = 0;
+
+    // Large subtrees are handed to other threads; the right one stays on this thread.
+    if (count > BVH::PARALLEL_THRESHOLD) {
+        #pragma omp task default(none) shared(node, prims) firstprivate(first, mid, depth)
+        node->children[0] = buildRecursive(prims, first, mid - first, depth + 1);
+        node->children[1] = buildRecursive(prims, mid, first + count - mid, depth + 1);
+        #pragma omp taskwait
+    } else {
+        node->children[0] = buildRecursive(prims, first, mid - first, depth + 1);
+        node->children[1] = buildRecursive(prims, mid, first + count - mid, depth + 1);
+    }
+    return node;
+}
+
+uint32_t flatten(const BuildNode* node, std::vector<BVHNode>& nodes, uint32_t depth, BVHBuildStats& stats) {
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes[index].bounds = node->bounds;
+    stats.maxDepth = std::max(stats.maxDepth, depth);
+
+    if (node->count > 0) {
+        nodes[index].offset = node->first;
+        nodes[index].count = static_cast<uint16_t>(node->count);
+        nodes[index].type = node->type;
+        stats.leafCount++;
+        return index;
+    }
+
+    nodes[index].axis = node->axis;
+    flatten(node->children[0].get(), nodes, depth + 1, stats);
+    nodes[index].offset = flatten(node->children[1].get(), nodes, depth + 1, stats);
+    return index;
+}
+
+uint32_t computeSpine(BuildNode* node) {
+    if (node->count == 0)
+        node->spine = 1 + std::min(computeSpine(node->children[0].get()), computeSpine(node->children[1].get()));
+    return node->spine;
+}
+
+// Turns leaf ranges of the build array into pool slots.
+void remapLeaves(BuildNode* node, const std::vector<uint32_t>& poolOffset) {
+    if (node->count > 0) {
+        node->first = poolOffset[node->first];
+        return;
+    }
+    remapLeaves(node->children[0].get(), poolOffset);
+    remapLeaves(node->children[1].get(), poolOffset);
+}
+
+// Writes a rebuilt subtree depth-first with its root at index at. Left children have to
+// follow their parent, so nodes go into the indices up to end, which the replaced subtree
+// frees, as long as the shortest path down from them fits; the other subtrees are appended.
+// Where the natural left child's path would not fit, the children trade places; that node
+// then visits its far child first, which costs time but not correctness. Returns the index
+// after the last node written in place.
+uint32_t placeSubtree(const BuildNode* node, uint32_t at, uint32_t end, std::vector<BVHNode>& nodes) {
+    nodes[at] = BVHNode();
+    nodes[at].bounds = node->bounds;
+    if (node->count > 0) {
+        nodes[at].offset = node->first;
+        nodes[at].count = static_cast<uint16_t>(node->count);
+        nodes[at].type = node->type;
+        return at + 1;
+    }
+
+    const BuildNode* left = node->children[0].get();
+    const BuildNode* right = node->children[1].get();
+    if (left->spine > end - at - 1)
+        std::swap(left, right);
+    nodes[at].axis = node->axis;
+    uint32_t next = placeSubtree(left, at + 1, end, nodes);
+    if (next < end && right->spine <= end - next) {
+        nodes[at].offset = next;
+        return placeSubtree(right, next, end, nodes);
+    }
+    BVHBuildStats appended;
+    uint32_t rightIndex = flatten(right, nodes, 0, appended);
+    nodes[at].offset = rightIndex;
+    return next;
+}
+
+// Slab-tests one box against every lane of the packet. Returns the mask of lanes whose
+// ray enters the box before its own tMax.
+inline uint32_t intersectLanes(const AABB& bounds, const RayPacket& packet, const float* tMax) {
+#if defined(__AVX__)
+    const __m256 ix = _mm256_load_ps(packet.invX);
+    const __m256 iy = _mm256_load_ps(packet.invY);
+    const __m256 iz = _mm256_load_ps(packet.invZ);
+    const glm::vec3 lo = bounds.min - packet.origin;
+    const glm::vec3 hi = bounds.max - packet.origin;
+
+    __m256 tx0 = _mm256_mul_ps(_mm256_set1_ps(lo.x), ix);
+    __m256 tx1 = _mm256_mul_ps(_mm256_set1_ps(hi.x), ix);
+    __m256 ty0 = _mm256_mul_ps(_mm256_set1_ps(lo.y), iy);
+    __m256 ty1 = _mm256_mul_ps(_mm256_set1_ps(hi.y), iy);
+    __m256 tz0 = _mm256_mul_ps(_mm256_set1_ps(lo.z), iz);
+    __m256 tz1 = _mm256_mul_ps(_mm256_set1_ps(hi.z), iz);
+
+    __m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)),
+                                 _mm256_max_ps(_mm256_min_ps(tz0, tz1), _mm256_setzero_ps()));
+    __m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)),
+                                _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_load_ps(tMax)));
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < RayPacket::SIZE; i++) {
+        glm::vec3 invDir(packet.invX[i], packet.invY[i], packet.invZ[i]);
+        float tNear;
+        if (bounds.intersect(packet.origin, invDir, 0.0f, tMax[i], tNear))
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+// Slab-tests one box against every lane of a batch. Returns the mask of lanes whose ray
+// enters the box before its own tMax.
+inline uint32_t intersectLanes(const AABB& bounds, const RayBatch& batch, const float* tMax) {
+#if defined(__AVX__)
+    const __m256 ix = _mm256_load_ps(batch.invX);
+    const __m256 iy = _mm256_load_ps(batch.invY);
+    const __m256 iz = _mm256_load_ps(batch.invZ);
+    const __m256 ox = _mm256_load_ps(batch.scaledX);
+    const __m256 oy = _mm256_load_ps(batch.scaledY);
+    const __m256 oz = _mm256_load_ps(batch.scaledZ);
+
+#if defined(__FMA__)
+    __m256 tx0 = _mm256_fmsub_ps(_mm256_set1_ps(bounds.min.x), ix, ox);
+    __m256 tx1 = _mm256_fmsub_ps(_mm256_set1_ps(bounds.max.x), ix, ox);
+    __m256 ty0 = _mm256_fmsub_ps(_mm256_set1_ps(bounds.min.y), iy, oy);
+    __m256 ty1 = _mm256_fmsub_ps(_mm256_set1_ps(bounds.max.y), iy, oy);
+    __m256 tz0 = _mm256_fmsub_ps(_mm256_set1_ps(bounds.min.z), iz, oz);
+    __m256 tz1 = _mm256_fmsub_ps(_mm256_set1_ps(bounds.max.z), iz, oz);
+#else
+    __m256 tx0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(bounds.min.x), ix), ox);
+    __m256 tx1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(bounds.max.x), ix), ox);
+    __m256 ty0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(bounds.min.y), iy), oy);
+    __m256 ty1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(bounds.max.y), iy), oy);
+    __m256 tz0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(bounds.min.z), iz), oz);
+    __m256 tz1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(bounds.max.z), iz), oz);
+#endif
+
+    __m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)),
+                                 _mm256_max_ps(_mm256_min_ps(tz0, tz1), _mm256_setzero_ps()));
+    __m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)),
+                                _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_load_ps(tMax)));
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < RayBatch::SIZE; i++) {
+        glm::vec3 invDir(batch.invX[i], batch.invY[i], batch.invZ[i]);
+        float tNear;
+        if (bounds.intersect(batch.origin(i), invDir, 0.0f, tMax[i], tNear))
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+} // namespace
+
+BVH::BVH(const std::vector<AABB>& primBounds, const std::vector<uint8_t>& primTypes) {
+    build(primBounds, primTypes);
+}
+
+void BVH::build(const std::vector<AABB>& primBounds, const std::vector<uint8_t>& primTypes) {
+    auto start = std::chrono::steady_clock::now();
+
+    nodes.clear();
+    primIndices.clear();
+    stats = BVHBuildStats();
+    if (primBounds.empty())
+        return;
+
+    std::vector<BuildPrim> prims(primBounds.size());
+    #pragma omp parallel for
+    for (size_t i = 0; i < primBounds.size(); i++) {
+        prims[i].bounds = primBounds[i];
+        prims[i].centroid = primBounds[i].centroid();
+        prims[i].index = static_cast<uint32_t>(i);
+        prims[i].type = primTypes.empty() ? 0 : primTypes[i];
+    }
+
+    std::unique_ptr<BuildNode> root;
+    #pragma omp parallel default(none) shared(root, prims)
+    #pragma omp single
+    root = buildRecursive(prims.data(), 0, static_cast<uint32_t>(prims.size()), 0);
+
+    std::vector<BVHNode> flat;
+    flat.reserve(2 * prims.size());
+    flatten(root.get(), flat, 0, stats);
+    flat.shrink_to_fit();
+
+    // Leaf offsets become positions within the pool of the leaf's type, which is
+    // where the primitives end up once the pools are reordered by primIndices.
+    std::vector<uint32_t> poolOffset(prims.size());
+    uint32_t typeCounts[256] = {};
+    primIndices.resize(prims.size());
+    for (size_t i = 0; i < prims.size(); i++) {
+        primIndices[i] = prims[i].index;
+        poolOffset[i] = typeCounts[prims[i].type]++;
+    }
+    for (BVHNode& node : flat) {
+        if (node.isLeaf())
+            node.offset = poolOffset[node.offset];
+    }
+    nodes = Buffer<BVHNode>(std::move(flat));
+
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+    stats.sahCost = computeSAHCost();
+    stats.buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+float BVH::computeSAHCost() const {
+    if (nodes.empty())
+        return 0.0f;
+
+    float rootArea = nodes[0].bounds.surfaceArea();
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    float cost = 0.0f;
+    for (const BVHNode& node : nodes) {
+        float area = node.bounds.surfaceArea() / rootArea;
+        if (node.isLeaf())
+            cost += area * INTERSECTION_COST * leafGroups(node.count);
+        else
+            cost += area * TRAVERSAL_COST;
+    }
+    return cost;
+}
+
+float BVH::subtreeCost(uint32_t node) const {
+    const BVHNode& n = nodes[node];
+    float area = n.bounds.surfaceArea();
+    if (n.isLeaf())
+        return area * INTERSECTION_COST * leafGroups(n.count);
+    return area * TRAVERSAL_COST + subtreeCosts[node + 1] + subtreeCosts[n.offset];
+}
+
+void BVH::linkSubtree(uint32_t root, bool resetBuiltCosts) {
+    // Breadth-first, so walking the list backwards meets children before their parents.
+    std::vector<uint32_t> order = { root };
+    for (size_t k = 0; k < order.size(); k++) {
+        uint32_t index = order[k];
+        const BVHNode& node = nodes[index];
+        if (node.isLeaf()) {
+            std::vector<uint32_t>& leaves = primitiveLeaves[node.type];
+            if (leaves.size() < node.offset + node.count)
+                leaves.resize(node.offset + node.count, NO_NODE);
+            std::fill(leaves.begin() + node.offset, leaves.begin() + node.offset + node.count, index);
+            continue;
+        }
+        for (uint32_t child : { index + 1, node.offset }) {
+            parents[child] = index;
+            depths[child] = static_cast<uint16_t>(depths[index] + 1);
+            stats.maxDepth = std::max(stats.maxDepth, static_cast<uint32_t>(depths[child]));
+            order.push_back(child);
+        }
+    }
+
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        subtreeCosts[*it] = subtreeCost(*it);
+        if (resetBuiltCosts)
+            builtCosts[*it] = subtreeCosts[*it];
+    }
+    for (uint32_t node = parents[root]; node != NO_NODE; node = parents[node])
+        subtreeCosts[node] = subtreeCost(node);
+
+    float rootArea = nodes[0].bounds.surfaceArea();
+    stats.sahCost = rootArea > 0.0f ? subtreeCosts[0] / rootArea : 0.0f;
+}
+
+void BVH::prepareRefit() {
+    if (nodes.empty() || !parents.empty())
+        return;
+    const size_t count = nodes.size();
+    parents.assign(count, NO_NODE);
+    depths.assign(count, 0);
+    subtreeCosts.assign(count, 0.0f);
+    builtCosts.assign(count, 0.0f);
+    visited.assign(count, 0);
+    linkSubtree(0, true);
+}
+
+void BVH::refit(const PrimitivePools& primitives, std::vector<uint32_t> leaves, std::vector<uint32_t>& refitted) {
+    refitted.clear();
+    if (leaves.empty())
+        return;
+    std::sort(leaves.begin(), leaves.end());
+    leaves.erase(std::unique(leaves.begin(), leaves.end()), leaves.end());
+
+    std::vector<BVHNode>& flat = nodes.values();
+    #pragma omp parallel for if (leaves.size() >= REFIT_PARALLEL_THRESHOLD)
+    for (size_t k = 0; k < leaves.size(); k++) {
+        BVHNode& leaf = flat[leaves[k]];
+        AABB bounds;
+        for (uint32_t i = leaf.offset; i < leaf.offset + leaf.count; i++)
+            bounds.expand(primitives.bounds(static_cast<PrimitiveType>(leaf.type), i));
+        leaf.bounds = bounds;
+        subtreeCosts[leaves[k]] = subtreeCost(leaves[k]);
+    }
+
+    // Every ancestor once, deepest first. The nodes of one depth only read children
+    // that are already done, so each depth is refitted in parallel.
+    std::vector<uint32_t> ancestors;
+    for (uint32_t leaf : leaves) {
+        for (uint32_t node = parents[leaf]; node != NO_NODE && !visited[node]; node = parents[node]) {
+            visited[node] = 1;
+            ancestors.push_back(node);
+        }
+    }
+    std::sort(ancestors.begin(), ancestors.end(), [&](uint32_t a, uint32_t b) { return depths[a] > depths[b]; });
+
+    for (size_t begin = 0; begin < ancestors.size();) {
+        size_t end = begin;
+        while (end < ancestors.size() && depths[ancestors[end]] == depths[ancestors[begin]])
+            end++;
+        #pragma omp parallel for if (end - begin >= REFIT_PARALLEL_THRESHOLD)
+        for (size_t k = begin; k < end; k++) {
+            uint32_t index = ancestors[k];
+            BVHNode& node = flat[index];
+            node.bounds = flat[index + 1].bounds;
+            node.bounds.expand(flat[node.offset].bounds);
+            subtreeCosts[index] = subtreeCost(index);
+        }
+        begin = end;
+    }
+
+    for (uint32_t node : ancestors)
+        visited[node] = 0;
+    refitted = std::move(leaves);
+    refitted.insert(refitted.end(), ancestors.begin(), ancestors.end());
+
+    float rootArea = nodes[0].bounds.surfaceArea();
+    stats.sahCost = rootArea > 0.0f ? subtreeCosts[0] / rootArea : 0.0f;
+}
+
+std::vector<uint32_t> BVH::degradedSubtrees(const std::vector<uint32_t>& refitted) {
+    // Flag the degraded nodes, so checking whether one lies below another is a walk up its parents.
+    std::vector<uint32_t> degraded;
+    for (uint32_t node : refitted) {
+        if (!nodes[node].isLeaf() && subtreeCosts[node] > REBUILD_THRESHOLD * builtCosts[node]) {
+            degraded.push_back(node);
+            visited[node] = 1;
+        }
+    }
+
+    std::vector<uint32_t> topmost;
+    for (uint32_t node : degraded) {
+        bool covered = false;
+        for (uint32_t above = parents[node]; above != NO_NODE && !covered; above = parents[above])
+            covered = visited[above];
+        if (!covered)
+            topmost.push_back(node);
+    }
+    for (uint32_t node : degraded)
+        visited[node] = 0;
+    return topmost;
+}
+
+bool BVH::rebuildSubtree(uint32_t root, const PrimitivePools& primitives, SubtreeOrder& order) {
+    // Per type, the subtree's leaves cover one contiguous pool range.
+    uint32_t first[2] = { NO_NODE, NO_NODE };
+    uint32_t count[2] = {};
+    std::vector<uint32_t> oldNodes;
+    std::vector<uint32_t> stack = { root };
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        oldNodes.push_back(index);
+        const BVHNode& node = nodes[index];
+        if (node.isLeaf()) {
+            first[node.type] = std::min(first[node.type], node.offset);
+            count[node.type] += node.count;
+        } else {
+            stack.push_back(index + 1);
+            stack.push_back(node.offset);
+        }
+    }
+    // The run of indices from root the old subtree held. Descendants come after their
+    // parent, so root is its first index.
+    std::sort(oldNodes.begin(), oldNodes.end());
+    uint32_t end = root;
+    while (end - root < oldNodes.size() && oldNodes[end - root] == end)
+        end++;
+
+    std::vector<BuildPrim> prims;
+    prims.reserve(count[0] + count[1]);
+    for (uint8_t type = 0; type < 2; type++) {
+        for (uint32_t slot = first[type]; slot < first[type] + count[type]; slot++) {
+            AABB bounds = primitives.bounds(static_cast<PrimitiveType>(type), slot);
+            prims.push_back({ bounds, bounds.centroid(), slot, type });
+        }
+    }
+
+    std::unique_ptr<BuildNode> tree;
+    const uint32_t depth = depths[root];
+    #pragma omp parallel default(none) shared(tree, prims) firstprivate(depth)
+    #pragma omp single
+    tree = buildRecursive(prims.data(), 0, static_cast<uint32_t>(prims.size()), depth);
+    if (computeSpine(tree.get()) > end - root)
+        return false;
+
+    std::vector<uint32_t> poolOffset(prims.size());
+    for (int type = 0; type < 2; type++) {
+        order.first[type] = count[type] > 0 ? first[type] : 0;
+        order.order[type].clear();
+    }
+    for (size_t i = 0; i < prims.size(); i++) {
+        uint8_t type = prims[i].type;
+        poolOffset[i] = first[type] + static_cast<uint32_t>(order.order[type].size());
+        order.order[type].push_back(prims[i].index - first[type]);
+    }
+    remapLeaves(tree.get(), poolOffset);
+
+    std::vector<BVHNode>& flat = nodes.values();
+    uint32_t reused = placeSubtree(tree.get(), root, end, flat) - root;
+    nodes.sync();
+    unreachableCount += static_cast<uint32_t>(oldNodes.size()) - reused;
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+
+    const size_t size = nodes.size();
+    parents.resize(size, NO_NODE);
+    depths.resize(size, 0);
+    subtreeCosts.resize(size, 0.0f);
+    builtCosts.resize(size, 0.0f);
+    visited.resize(size, 0);
+    linkSubtree(root, true);
+    return true;
+}
+
+bool BVH::intersect(const PrimitivePools& primitives,
+                    const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
+    if (nodes.empty())
+        return false;
+
+    PrimitiveHit hit;
+    traverse(0, primitives, origin, dir, hit);
+    if (hit.t == std::numeric_limits<float>::infinity())
+        return false;
+    primitives.fillHitRecord(hit, origin, dir, rec);
+    return true;
+}
+
+void BVH::traverse(uint32_t root, const PrimitivePools& primitives,
+                   const glm::vec3& origin, const glm::vec3& dir, PrimitiveHit& hit) const {
+    glm::vec3 invDir = 1.0f / dir;
+    bool dirIsNeg[3] = { invDir.x < 0.0f, invDir.y < 0.0f, invDir.z < 0.0f };
+
+    uint32_t stack[MAX_DEPTH];
+    int stackSize = 0;
+    uint32_t current = root;
+
+    while (true) {
+        const BVHNode& node = nodes[current];
+        float tNear;
+        if (node.bounds.intersect(origin, invDir, 0.0f, hit.t, tNear)) {
+            if (node.isLeaf()) {
+                primitives.intersect(static_cast<PrimitiveType>(node.type), node.offset, node.count, origin, dir, hit);
+            } else if (dirIsNeg[node.axis]) {
+                // Visit the right child first when the ray travels towards -axis.
+                stack[stackSize++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        current = stack[--stackSize];
+    }
+}
+
+uint32_t BVH::intersect(const PrimitivePools& primitives, const RayPacket& packet, HitRecord* records) const {
+    uint32_t found = 0;
+    if (nodes.empty())
+        return found;
+
+    // Without a common direction per axis there is no interval to cull with, nor a
+    // child order that suits every ray.
+    if (!packet.coherent) {
+        for (int i = 0; i < packet.count; i++) {
+            if (intersect(primitives, packet.origin, packet.direction(i), records[i]))
+                found |= 1u << i;
+        }
+        return found;
+    }
+
+    const uint32_t active = packet.activeMask();
+    PrimitiveHit hits[RayPacket::SIZE];
+    alignas(32) float tMax[RayPacket::SIZE];
+    std::fill(tMax, tMax + RayPacket::SIZE, std::numeric_limits<float>::infinity());
+    float packetTMax = std::numeric_limits<float>::infinity();
+
+    uint32_t stack[MAX_DEPTH];
+    int stackSize = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const BVHNode& node = nodes[current];
+        uint32_t mask = packet.mayHit(node.bounds, packetTMax) ? intersectLanes(node.bounds, packet, tMax) & active : 0;
+        if (mask) {
+            if (node.isLeaf() || std::popcount(mask) == 1) {
+                // Leaves are tested ray by ray. A single surviving ray finishes the
+                // subtree on its own rather than dragging the packet along.
+                for (uint32_t lanes = mask; lanes; lanes &= lanes - 1) {
+                    int lane = std::countr_zero(lanes);
+                    if (node.isLeaf())
+                        primitives.intersect(static_cast<PrimitiveType>(node.type), node.offset, node.count,
+                                             packet.origin, packet.direction(lane), hits[lane]);
+                    else
+                        traverse(current, primitives, packet.origin, packet.direction(lane), hits[lane]);
+                    tMax[lane] = hits[lane].t;
+                }
+                packetTMax = 0.0f;
+                for (int i = 0; i < packet.count; i++)
+                    packetTMax = std::max(packetTMax, tMax[i]);
+            } else if (packet.negative[node.axis]) {
+                stack[stackSize++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        current = stack[--stackSize];
+    }
+
+    for (int i = 0; i < packet.count; i++) {
+        if (hits[i].t == std::numeric_limits<float>::infinity())
+            continue;
+        primitives.fillHitRecord(hits[i], packet.origin, packet.direction(i), records[i]);
+        found |= 1u << i;
+    }
+    return found;
+}
+
+uint32_t BVH::intersect(const PrimitivePools& primitives, const RayBatch& batch, HitRecord* records) const {
+    uint32_t found = 0;
+    if (nodes.empty())
+        return found;
+
+    const uint32_t active = batch.activeMask();
+    PrimitiveHit hits[RayBatch::SIZE];
+    alignas(32) float tMax[RayBatch::SIZE];
+    for (int i = 0; i < RayBatch::SIZE; i++) {
+        tMax[i] = batch.tMax[i];
+        hits[i].t = batch.tMax[i];
+    }
+
+    uint32_t stack[MAX_DEPTH];
+    int stackSize = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const BVHNode& node = nodes[current];
+        uint32_t mask = intersectLanes(node.bounds, batch, tMax) & active;
+        if (mask) {
+            if (node.isLeaf() || std::popcount(mask) == 1) {
+                // As for packets: leaves are tested ray by ray, and a single surviving
+                // ray finishes the subtree on its own.
+                for (uint32_t lanes = mask; lanes; lanes &= lanes - 1) {
+                    int lane = std::countr_zero(lanes);
+                    if (node.isLeaf())
+                        primitives.intersect(static_cast<PrimitiveType>(node.type), node.offset, node.count,
+                                             batch.origin(lane), batch.direction(lane), hits[lane]);
+                    else
+                        traverse(current, primitives, batch.origin(lane), batch.direction(lane), hits[lane]);
+                    tMax[lane] = hits[lane].t;
+                }
+            } else if (batch.negative[node.axis]) {
+                stack[stackSize++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        current = stack[--stackSize];
+    }
+
+    for (int i = 0; i < batch.count; i++) {
+        if (hits[i].t == batch.tMax[i])
+            continue;
+        primitives.fillHitRecord(hits[i], batch.origin(i), batch.direction(i), records[i]);
+        found |= 1u << i;
+    }
+    return found;
+}
+
+bool BVH::occluded(const PrimitivePools& primitives,
+                   const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    if (nodes.empty())
+        return false;
+    return traverseAny(0, primitives, origin, dir, tMax);
+}
+
+uint32_t BVH::occluded(const PrimitivePools& primitives, const RayBatch& batch) const {
+    uint32_t blocked = 0;
+    if (nodes.empty())
+        return blocked;
+
+    const uint32_t active = batch.activeMask();
+    uint32_t stack[MAX_DEPTH];
+    int stackSize = 0;
+    uint32_t current = 0;
+
+    // Blocked rays drop out of the batch; child order does not matter for any-hit queries.
+    while (true) {
+        const BVHNode& node = nodes[current];
+        uint32_t mask = intersectLanes(node.bounds, batch, batch.tMax) & active & ~blocked;
+        if (mask) {
+            if (node.isLeaf() || std::popcount(mask) == 1) {
+                for (uint32_t lanes = mask; lanes; lanes &= lanes - 1) {
+                    int lane = std::countr_zero(lanes);
+                    bool hit = node.isLeaf()
+                        ? primitives.occluded(static_cast<PrimitiveType>(node.type), node.offset, node.count,
+                                              batch.origin(lane), batch.direction(lane), batch.tMax[lane])
+                        : traverseAny(current, primitives, batch.origin(lane), batch.direction(lane), batch.tMax[lane]);
+                    if (hit)
+                        blocked |= 1u << lane;
+                }
+                if (blocked == active)
+                    break;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        current = stack[--stackSize];
+    }
+    return blocked;
+}
+
+bool BVH::traverseAny(uint32_t root, const PrimitivePools& primitives,
+                      const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    glm::vec3 invDir = 1.0f / dir;
+
+    uint32_t stack[MAX_DEPTH];
+    int stackSize = 0;
+    uint32_t current = root;
+
+    // Child order does not matter for an any-hit query.
+    while (true) {
+        const BVHNode& node = nodes[current];
+        float tNear;
+        if (node.bounds.intersect(origin, invDir, 0.0f, tMax, tNear)) {
+            if (node.isLeaf()) {
+                if (primitives.occluded(static_cast<PrimitiveType>(node.type), node.offset, node.count,
+                                        origin, dir, tMax))
+                    return true;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        current = stack[--stackSize];
+    }
+
+    return false;
+}
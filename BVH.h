@@ -0,0 +1,162 @@
+//
+// Created by alex on 3/14/25.
+//
+
+// BVH.h
+#ifndef BVH_H
+#define BVH_H
+
+#include "AABB.h"
+#include "Buffer.h"
+#include "Primitives.h"
+#include "RayPacket.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Node of the flattened BVH. Nodes are stored depth-first, so the left child of an
+// interior node is always the next node in the array and only the right child is stored.
+struct alignas(32) BVHNode {
+    AABB bounds;
+    uint32_t offset = 0;   // Leaf: first primitive in the pool of its type. Interior: right child.
+    uint16_t count = 0;    // Number of primitives, 0 for interior nodes.
+    uint8_t axis = 0;      // Split axis, used to pick the near child first.
+    uint8_t type = 0;      // Leaf: PrimitiveType shared by all its primitives.
+
+    bool isLeaf() const { return count > 0; }
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode should fit two nodes per cache line");
+
+struct BVHBuildStats {
+    double buildTimeMs = 0.0;
+    float sahCost = 0.0f;
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t maxDepth = 0;
+};
+
+// Bounding volume hierarchy built with binned SAH splits.
+// The BVH only knows primitive bounds and types. Leaves never mix types, and their
+// offsets assume the pools have been reordered with primIndices (PrimitivePools::reorder),
+// so each leaf is a contiguous range of one pool.
+class BVH {
+public:
+    static constexpr int BIN_COUNT = 16;
+    static constexpr int MAX_LEAF_SIZE = 8;             // Leaves are forced to split above this.
+    static constexpr int PARALLEL_THRESHOLD = 4096;     // Smaller subtrees are built on one thread.
+    static constexpr float TRAVERSAL_COST = 1.0f;
+    static constexpr float INTERSECTION_COST = 1.0f;
+    static constexpr float REBUILD_THRESHOLD = 2.0f;        // Refitted subtrees past this multiple of their built SAH cost are rebuilt.
+    static constexpr int REFIT_PARALLEL_THRESHOLD = 1024;   // Smaller batches of nodes are refitted on one thread.
+    static constexpr uint32_t NO_NODE = 0xFFFFFFFFu;
+    static constexpr int MAX_DEPTH = 64;                // Deepest a node can be; sizes the traversal stacks.
+    static constexpr int SAH_DEPTH_LIMIT = 32;          // Deeper ranges are halved, which keeps any input within MAX_DEPTH.
+#if defined(__AVX__)
+    static constexpr int LEAF_GROUP_SIZE = 8;           // Primitives a leaf tests at once, see TrianglePool and SpherePool.
+#else
+    static constexpr int LEAF_GROUP_SIZE = 1;
+#endif
+
+    // SAH cost of intersecting count primitives in a leaf, in units of INTERSECTION_COST.
+    static constexpr float leafGroups(uint32_t count) {
+        return static_cast<float>((count + LEAF_GROUP_SIZE - 1) / LEAF_GROUP_SIZE);
+    }
+
+    Buffer<BVHNode> nodes;
+    BVHBuildStats stats;
+
+    // primIndices maps leaf order back to positions in primBounds.
+    std::vector<uint32_t> primIndices;
+
+    BVH(const std::vector<AABB>& primBounds, const std::vector<uint8_t>& primTypes);
+
+    // Empty BVH, for nodes that are filled in from a scene cache.
+    BVH() = default;
+
+    // Closest hit against the primitives the BVH was built from.
+    bool intersect(const PrimitivePools& primitives,
+                   const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const;
+
+    // Closest hits of a packet of rays; returns a mask of the rays that hit something.
+    // Nodes are culled for the whole packet at once, and rays that end up alone in a
+    // subtree, or packets that are not coherent, continue as single rays.
+    uint32_t intersect(const PrimitivePools& primitives, const RayPacket& packet, HitRecord* records) const;
+
+    // Closest hits of a batch of rays, each within its own tMax; returns a mask of the rays
+    // that hit something. Like packets, rays that end up alone in a subtree continue as
+    // single rays.
+    uint32_t intersect(const PrimitivePools& primitives, const RayBatch& batch, HitRecord* records) const;
+
+    // True if any primitive blocks the ray before tMax. Stops at the first hit found.
+    bool occluded(const PrimitivePools& primitives,
+                  const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+
+    // Mask of the rays of batch that something blocks before their tMax.
+    uint32_t occluded(const PrimitivePools& primitives, const RayBatch& batch) const;
+
+    // Expected cost of a random ray, relative to the root surface area.
+    float computeSAHCost() const;
+
+    // Pool ranges of a rebuilt subtree in their new order: per PrimitiveType, slot
+    // first + i of the pool receives the primitive at first + order[i].
+    struct SubtreeOrder {
+        uint32_t first[2] = {};
+        std::vector<uint32_t> order[2];
+    };
+
+    // Incremental updates, driven by Scene::updateBVH. prepareRefit sets up the parent
+    // links, the leaf of every primitive and the SAH cost every subtree was built with;
+    // it is a no-op once done, and rebuildSubtree keeps all of it current.
+    void prepareRefit();
+
+    uint32_t parent(uint32_t node) const { return parents[node]; }
+    uint32_t leafOf(PrimitiveType type, uint32_t slot) const { return primitiveLeaves[static_cast<int>(type)][slot]; }
+
+    // Nodes no longer reachable from the root, left behind by rebuildSubtree.
+    uint32_t unreachableNodes() const { return unreachableCount; }
+
+    // Recomputes the bounds of the given leaves from the pools, then of their ancestors,
+    // one depth at a time from the deepest, each depth in parallel. Every node whose bounds
+    // were recomputed is written to refitted.
+    void refit(const PrimitivePools& primitives, std::vector<uint32_t> leaves, std::vector<uint32_t>& refitted);
+
+    // The interior nodes among refitted whose SAH cost has grown past REBUILD_THRESHOLD
+    // times their built cost, leaving out those below another such node.
+    std::vector<uint32_t> degradedSubtrees(const std::vector<uint32_t>& refitted);
+
+    // Rebuilds the subtree at root with binned SAH over its own primitives, which keep
+    // their pool ranges. The new nodes reuse the indices of the old ones where the depth-first
+    // layout allows and are appended otherwise. Returns false, leaving the BVH as it was, if
+    // not even the new subtree's shortest path fits. Otherwise the pool ranges must be
+    // reordered with order.
+    bool rebuildSubtree(uint32_t root, const PrimitivePools& primitives, SubtreeOrder& order);
+
+private:
+    void build(const std::vector<AABB>& primBounds, const std::vector<uint8_t>& primTypes);
+
+    // Single-ray closest hit search of the subtree at root, closer than hit.t.
+    void traverse(uint32_t root, const PrimitivePools& primitives,
+                  const glm::vec3& origin, const glm::vec3& dir, PrimitiveHit& hit) const;
+
+    // Any-hit search of the subtree at root.
+    bool traverseAny(uint32_t root, const PrimitivePools& primitives,
+                     const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+
+    // SAH cost of the subtree at node, weighted by surface area, from its children's.
+    float subtreeCost(uint32_t node) const;
+
+    // Sets parents, depths and leaves below root, then the costs of its subtree and its ancestors.
+    void linkSubtree(uint32_t root, bool resetBuiltCosts);
+
+    std::vector<uint32_t> parents;
+    std::vector<uint16_t> depths;
+    std::vector<uint32_t> primitiveLeaves[2];   // Per PrimitiveType and pool slot.
+    std::vector<float> subtreeCosts;
+    std::vector<float> builtCosts;              // subtreeCosts when the subtree was built.
+    std::vector<uint8_t> visited;               // Scratch for refit and degradedSubtrees, all zero between calls.
+    uint32_t unreachableCount = 0;
+};
+
+#endif // BVH_H
@@ -0,0 +1,110 @@
+//
+// Created by alex on 3/26/25.
+//
+
+// Buffer.h
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <cstddef>
+#include <vector>
+
+// Contiguous array that either owns its elements or views memory owned elsewhere, such
+// as a memory-mapped scene cache. Reads go through the same pointer in both cases, so
+// traversal code does not care where the data lives. The first modification of a view
+// copies it into owned storage.
+template <typename T>
+class Buffer {
+public:
+    Buffer() = default;
+    Buffer(std::vector<T>&& values) : owned(std::move(values)) { sync(); }
+
+    Buffer(const Buffer& other) : owned(other.owned), viewing(other.viewing) {
+        if (viewing) {
+            ptr = other.ptr;
+            count = other.count;
+        } else {
+            sync();
+        }
+    }
+
+    Buffer(Buffer&& other) noexcept : owned(std::move(other.owned)), viewing(other.viewing) {
+        if (viewing) {
+            ptr = other.ptr;
+            count = other.count;
+        } else {
+            sync();
+        }
+        other.reset();
+    }
+
+    Buffer& operator=(Buffer other) noexcept {
+        owned.swap(other.owned);
+        viewing = other.viewing;
+        if (viewing) {
+            ptr = other.ptr;
+            count = other.count;
+        } else {
+            sync();
+        }
+        return *this;
+    }
+
+    // Non-owning view of count elements at data. The memory must outlive the buffer.
+    static Buffer view(const T* data, size_t count) {
+        Buffer buffer;
+        buffer.ptr = data;
+        buffer.count = count;
+        buffer.viewing = true;
+        return buffer;
+    }
+
+    bool isView() const { return viewing; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T* data() const { return ptr; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T& back() const { return ptr[count - 1]; }
+
+    // Mutable access; detaches a view first.
+    T& at(size_t i) { return values()[i]; }
+
+    void push_back(const T& value) { values().push_back(value); sync(); }
+    void resize(size_t n, const T& value = T()) { values().resize(n, value); sync(); }
+    void reserve(size_t n) { values().reserve(n); sync(); }
+    void append(const T* first, size_t n) { values().insert(owned.end(), first, first + n); sync(); }
+    void clear() { reset(); }
+
+    // Owned storage, copied out of the view if there was one. Call sync() after
+    // changing its size.
+    std::vector<T>& values() {
+        if (viewing) {
+            owned.assign(ptr, ptr + count);
+            viewing = false;
+            sync();
+        }
+        return owned;
+    }
+
+    void sync() {
+        ptr = owned.data();
+        count = owned.size();
+    }
+
+private:
+    void reset() {
+        owned.clear();
+        viewing = false;
+        sync();
+    }
+
+    std::vector<T> owned;
+    const T* ptr = nullptr;
+    size_t count = 0;
+    bool viewing = false;
+};
+
+#endif // BUFFER_H
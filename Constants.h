@@ -8,16 +8,10 @@
 #include "SpectralData.h"
 #include <glm/glm.hpp>
 
-// Ray
-static constexpr int maxDepth = 3;              // Reflection recursion depth.
-static constexpr int samplesPerPixel = 32;      // Increase for less noise.
-static constexpr float shadowBias = 1e-4f;      // To avoid self-intersection.
+// Progressive rendering. Per-render parameters live in RenderSettings.
+static constexpr int maxProgressiveSamples = 4096; // A still view stops refining after this many.
 
 // Scene
 static const Spectrum backgroundSpectrum = Spectrum::fromRGB(glm::vec3(0.0f, 0.0f, 0.0f)); // Black background
 
-// Camera
-static constexpr float fov = M_PI / 3.0f; // 60° field of view.
-static const float scale = std::tan(fov / 2.0f);
-
 #endif //CONSTANTS_H
@@ -6,22 +6,28 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
-#include "SpectralData.h"
-#include "BSDF.h"
 #include "AABB.h"
+#include "Sampler.h"
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 class Entity;
+struct PrimitivePools;
 
+// Geometry of a ray hit plus the index of the hit surface's material. Spectra and
+// BSDF are looked up in the scene's MaterialTable only when the hit is shaded.
 struct HitRecord {
+    static constexpr uint32_t NO_LIGHT = 0xFFFFFFFFu;
+
     float t = 0.0f;
     glm::vec3 hitPoint;
     glm::vec3 normal;
-    Spectrum color;
-    Spectrum emission;
-    bool isEmissive = false;
-    std::shared_ptr<Entity> hitEntity;
+    glm::vec2 uv = glm::vec2(0.0f);  // Interpolated texture coordinates, for meshes that have them.
+    uint32_t primitiveIndex = 0;   // Position in the primitive pool of its type.
+    uint32_t materialId = 0;
+    uint32_t lightIndex = NO_LIGHT;  // LightSampler emitter index if the hit surface is an emitter.
 };
 
 // Abstract base class for all scene entities.
@@ -31,27 +37,68 @@ public:
     // AABB
     virtual AABB getBounds() const = 0;
 
+    // Append this entity's geometry and material to the scene's primitive pools,
+    // which is what the BVH is built over and rays are traced against.
+    virtual void addToPools(PrimitivePools& pools) const = 0;
+
     // Test if the ray (origin, dir) intersects the entity.
     virtual bool intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const = 0;
 
-    // Add emission getter
-    virtual Spectrum getEmission() const {
-        return Spectrum(0.0f);  // Default is non-emissive
+    // Test if anything blocks the ray before tMax. Only answers yes/no, so overrides
+    // should skip everything intersect() computes for shading.
+    virtual bool occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+        HitRecord rec;
+        return intersect(origin, dir, rec) && rec.t < tMax;
     }
 
-    // Add emissive check
-    virtual bool isEmissive() const {
-        return false;  // Default is non-emissive
-    }
+    // Index of this entity's material in the scene's MaterialTable.
+    virtual uint32_t getMaterialId() const = 0;
 
     // New method for emissive entities
-    virtual void sampleLight(const glm::vec3& refPoint, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
+    virtual void sampleLight(const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
         // Default: do nothing if not emissive.
         pdf = 0.0f;
     }
 
-    // Virtual method for retrieving BSDF
-    virtual BSDF* getBSDF() const { return nullptr; }
+    // Solid angle density with which sampleLight, called from refPoint, returns lightPoint
+    // on a surface with the given normal. Used to weight hits found by BSDF sampling.
+    virtual float pdfLight(const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const {
+        return 0.0f;
+    }
+
+    // Area sampleLight draws points from, used to weight lights by emitted power.
+    // Entities that cannot be sampled keep 0, so a light sampler never picks them.
+    virtual float surfaceArea() const {
+        return 0.0f;
+    }
+
+    // Lights made of many primitives, such as emissive meshes, are sampled one part at a
+    // time so a light sampler can weigh the parts by power and distance. Part i is the i-th
+    // primitive addToPools adds. Entities that do not override this are a single part.
+    virtual uint32_t lightPartCount() const {
+        return 1;
+    }
+
+    virtual AABB partBounds(uint32_t part) const {
+        return getBounds();
+    }
+
+    virtual float partArea(uint32_t part) const {
+        return surfaceArea();
+    }
+
+    // sampleLight and pdfLight restricted to one part.
+    virtual void samplePart(uint32_t part, const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
+        sampleLight(refPoint, sampler, samplePoint, lightNormal, pdf);
+    }
+
+    virtual float pdfPart(uint32_t part, const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const {
+        return pdfLight(refPoint, lightPoint, lightNormal);
+    }
+
+    // Recomputes what the entity derives from its geometry after it was edited in place.
+    // Called by Scene::updateEntity.
+    virtual void geometryChanged() {}
 
     // Virtual destructor for proper cleanup.
     virtual ~Entity() = default;
@@ -62,30 +109,30 @@ public:
 class Triangle : public Entity {
 public:
     glm::vec3 v0, v1, v2;
-    Spectrum color;
-    Spectrum emission;
-    BSDF* bsdf;
+    uint32_t materialId;
 
     Triangle()
-        : v0(0.0f), v1(0.0f), v2(0.0f), color(1.0f), emission(0.0f), bsdf(nullptr) {}
+        : v0(0.0f), v1(0.0f), v2(0.0f), materialId(0) {}
 
-    Triangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, const Spectrum &color, const Spectrum &emission, BSDF* bsdf = nullptr)
-        : v0(v0), v1(v1), v2(v2), color(color), emission(emission), bsdf(bsdf) {}
+    Triangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, uint32_t materialId)
+        : v0(v0), v1(v1), v2(v2), materialId(materialId) {}
 
     bool intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const override;
 
-    Spectrum getEmission() const override {
-        return emission;
-    }
+    bool occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const override;
+
+    void addToPools(PrimitivePools& pools) const override;
 
-    bool isEmissive() const override {
-        return emission > 0.0f;
+    uint32_t getMaterialId() const override {
+        return materialId;
     }
 
-    void sampleLight(const glm::vec3& refPoint, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const override;
+    void sampleLight(const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const override;
 
-    BSDF* getBSDF() const override {
-        return bsdf;
+    float pdfLight(const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const override;
+
+    float surfaceArea() const override {
+        return 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
     }
 
     AABB getBounds() const override {
@@ -106,28 +153,22 @@ class Sphere : public Entity {
 public:
     glm::vec3 center;
     float radius;
-    Spectrum color;
-    Spectrum emission;
-    BSDF* bsdf;
+    uint32_t materialId;
 
     Sphere()
-    : center(0.0f, 0.0f, 0.0f), radius(1.0f), color(1.0f), emission(0.0f), bsdf(nullptr) {}
+    : center(0.0f, 0.0f, 0.0f), radius(1.0f), materialId(0) {}
 
-    Sphere(const glm::vec3& center, float radius, const Spectrum& color, const Spectrum& emission, BSDF* bsdf = nullptr)
-        : center(center), radius(radius), color(color), emission(emission), bsdf(bsdf) {}
+    Sphere(const glm::vec3& center, float radius, uint32_t materialId)
+        : center(center), radius(radius), materialId(materialId) {}
 
     bool intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const override;
 
-    Spectrum getEmission() const override {
-        return emission;
-    }
+    bool occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const override;
 
-    bool isEmissive() const override {
-        return emission > 0.0f;
-    }
+    void addToPools(PrimitivePools& pools) const override;
 
-    BSDF* getBSDF() const override {
-        return bsdf;
+    uint32_t getMaterialId() const override {
+        return materialId;
     }
 
     AABB getBounds() const override {
@@ -136,5 +177,106 @@ public:
 
 };
 
+// Many spheres sharing one material, such as the atoms of a molecule or the particles
+// of a simulation, without an Entity per sphere. Centers and radii are kept in separate
+// arrays; each sphere becomes its own BVH primitive when added to the pools.
+class SphereSet : public Entity {
+public:
+    std::vector<glm::vec3> centers;
+    std::vector<float> radii;          // One per center.
+    uint32_t materialId;
+
+    SphereSet(std::vector<glm::vec3> centers, std::vector<float> radii, uint32_t materialId)
+        : centers(std::move(centers)), radii(std::move(radii)), materialId(materialId) {}
+
+    size_t sphereCount() const { return centers.size(); }
+
+    bool intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const override;
+
+    bool occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const override;
+
+    void addToPools(PrimitivePools& pools) const override;
+
+    uint32_t getMaterialId() const override {
+        return materialId;
+    }
+
+    AABB getBounds() const override;
+};
+
+// Indexed triangle mesh. Vertices are stored once and shared by every triangle
+// that uses them; each triangle becomes its own BVH primitive when added to the pools.
+// normals and uvs are optional and, when present, hold one entry per position.
+class TriangleMesh : public Entity {
+public:
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;     // Three per triangle.
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    uint32_t materialId;
+
+    TriangleMesh(std::vector<glm::vec3> positions, std::vector<uint32_t> indices, uint32_t materialId,
+                 std::vector<glm::vec3> normals = {}, std::vector<glm::vec2> uvs = {});
+
+    size_t triangleCount() const { return indices.size() / 3; }
+
+    bool intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const override;
+
+    bool occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const override;
+
+    void addToPools(PrimitivePools& pools) const override;
+
+    uint32_t getMaterialId() const override {
+        return materialId;
+    }
+
+    // Picks a triangle in proportion to its area, then a uniform point on it, so the
+    // pdf is one over the total surface area.
+    void sampleLight(const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const override;
+
+    float pdfLight(const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const override;
+
+    float surfaceArea() const override {
+        return areaCdf.empty() ? 0.0f : areaCdf.back();
+    }
+
+    // Each triangle is its own light part.
+    uint32_t lightPartCount() const override {
+        return static_cast<uint32_t>(triangleCount());
+    }
+
+    AABB partBounds(uint32_t part) const override;
+
+    float partArea(uint32_t part) const override {
+        return triangleArea(part);
+    }
+
+    void samplePart(uint32_t part, const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const override;
+
+    float pdfPart(uint32_t part, const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const override;
+
+    void geometryChanged() override {
+        computeAreas();
+    }
+
+    AABB getBounds() const override;
+
+    // Rebuilds areaCdf, and with it surfaceArea, from the current positions.
+    void computeAreas();
+
+private:
+    std::vector<float> areaCdf;        // Running sum of triangle areas, for sampleLight.
+
+    glm::vec3 vertex(size_t triangle, int corner) const { return positions[indices[triangle * 3 + corner]]; }
+
+    float triangleArea(size_t triangle) const {
+        glm::vec3 v0 = vertex(triangle, 0);
+        return 0.5f * glm::length(glm::cross(vertex(triangle, 1) - v0, vertex(triangle, 2) - v0));
+    }
+
+    // Uniform point on one triangle.
+    void sampleTriangle(size_t triangle, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal) const;
+};
+
 #endif // ENTITY_H
 
@@ -0,0 +1,25 @@
+//
+// Created by alex on 3/21/25.
+//
+
+// ImageIO.cpp
+#include "ImageIO.h"
+#include <fstream>
+#include <vector>
+
+bool writePPM(const std::string& path, const uint32_t* pixels, int width, int height) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+        rgb[i * 3 + 0] = static_cast<uint8_t>(pixels[i] >> 16);
+        rgb[i * 3 + 1] = static_cast<uint8_t>(pixels[i] >> 8);
+        rgb[i * 3 + 2] = static_cast<uint8_t>(pixels[i]);
+    }
+    file.write(reinterpret_cast<const char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,15 @@
+//
+// Created by alex on 3/21/25.
+//
+
+// ImageIO.h
+#ifndef IMAGEIO_H
+#define IMAGEIO_H
+
+#include <cstdint>
+#include <string>
+
+// Writes packed ARGB pixels as a binary PPM (P6). Returns false if the file cannot be written.
+bool writePPM(const std::string& path, const uint32_t* pixels, int width, int height);
+
+#endif // IMAGEIO_H
@@ -7,7 +7,7 @@
 #define LAMBERTIANBSDF_H
 
 #include "BSDF.h"
-#include "SamplingHelpers.h" // For random_in_hemisphere
+#include "SamplingHelpers.h" // For OrthonormalBasis and sampleCosineHemisphere
 #include <glm/glm.hpp>
 #include <algorithm>
 
@@ -19,17 +19,47 @@ public:
 
     // For a Lambertian surface, the BSDF is diffuseColor / pi.
     Spectrum evaluate(const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal) const override {
-        float cosine = std::max(0.0f, glm::dot(normal, wo));
-        // Divide by PI (assumes cosine weighting in the integration)
-        return diffuseColor * (1.0f / M_PI) * cosine;
+        if (glm::dot(normal, wo) <= 0.0f)
+            return Spectrum(0.0f);
+        return diffuseColor * static_cast<float>(1.0 / M_PI);
     }
 
-    // Sample a new direction uniformly over the hemisphere
-    glm::vec3 sample(const glm::vec3& wi, const glm::vec3& normal, float& pdf) const override {
-        glm::vec3 sampledDir = random_in_hemisphere(normal);
-        // For a uniform hemisphere, pdf is 1/(2*pi)
-        pdf = 1.0f / (2.0f * M_PI);
-        return sampledDir;
+    SampledSpectrum evaluate(const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal,
+                             const SampledWavelengths& wavelengths) const override {
+        if (glm::dot(normal, wo) <= 0.0f)
+            return SampledSpectrum(0.0f);
+        return diffuseColor.sample(wavelengths) * static_cast<float>(1.0 / M_PI);
+    }
+
+    float pdf(const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal) const override {
+        return std::max(0.0f, glm::dot(normal, wo)) * static_cast<float>(1.0 / M_PI);
+    }
+
+    // Cosine-weighted sampling: the pdf cos / pi cancels the cosine and the 1 / pi of
+    // the BSDF, so the weight is just the diffuse color.
+    BSDFSample sample(const glm::vec3& wi, const glm::vec3& normal, Sampler& sampler) const override {
+        BSDFSample result;
+        if (sampleDirection(normal, sampler, result.direction, result.pdf))
+            result.weight = diffuseColor;
+        return result;
+    }
+
+    SampledBSDFSample sample(const glm::vec3& wi, const glm::vec3& normal,
+                             const SampledWavelengths& wavelengths, Sampler& sampler) const override {
+        SampledBSDFSample result;
+        if (sampleDirection(normal, sampler, result.direction, result.pdf))
+            result.weight = diffuseColor.sample(wavelengths);
+        return result;
+    }
+
+private:
+    static bool sampleDirection(const glm::vec3& normal, Sampler& sampler, glm::vec3& direction, float& pdf) {
+        glm::vec3 local = sampleCosineHemisphere(sampler.get2D());
+        if (local.z <= 0.0f)
+            return false;
+        direction = OrthonormalBasis(normal).toWorld(local);
+        pdf = local.z * static_cast<float>(1.0 / M_PI);
+        return true;
     }
 };
 
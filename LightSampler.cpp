@@ -0,0 +1,133 @@
+//
+// Created by alex on 3/27/25.
+//
+
+// LightSampler.cpp
+#include "LightSampler.h"
+#include <algorithm>
+
+LightSampler::LightSampler(const std::vector<std::shared_ptr<Entity>>& lights, const MaterialTable& materials) {
+    std::vector<float> power;
+    std::vector<AABB> bounds;
+    for (uint32_t light = 0; light < lights.size(); light++) {
+        const Spectrum& emission = materials[lights[light]->getMaterialId()].emission;
+        float meanEmission = 0.0f;
+        for (float sample : emission.samples)
+            meanEmission += sample;
+        meanEmission /= SPECTRAL_SAMPLES;
+        // Parts that cannot be sampled report no area and are never picked.
+        const uint32_t parts = lights[light]->lightPartCount();
+        for (uint32_t part = 0; part < parts; part++) {
+            emitters.push_back({ light, part });
+            power.push_back(meanEmission * lights[light]->partArea(part));
+            bounds.push_back(lights[light]->partBounds(part));
+        }
+    }
+
+    powerTable = AliasTable(power);
+    if (powerTable.empty())
+        return;
+
+    // Zero-power emitters stay out of the BVH, so its probabilities match the alias table's support.
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < emitters.size(); i++) {
+        if (power[i] > 0.0f)
+            order.push_back(i);
+    }
+    lightPaths.assign(emitters.size(), 0);
+    nodes.reserve(2 * order.size());
+    build(order, 0, order.size(), bounds, power, 0, 0);
+}
+
+// Splits at the median centroid along the longest axis, so the tree stays balanced and
+// an emitter's path from the root fits in 64 bits.
+uint32_t LightSampler::build(std::vector<uint32_t>& order, size_t first, size_t count,
+                             const std::vector<AABB>& bounds, const std::vector<float>& power,
+                             uint64_t path, uint32_t depth) {
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    AABB nodeBounds, centroidBounds;
+    float nodePower = 0.0f;
+    for (size_t i = first; i < first + count; i++) {
+        nodeBounds.expand(bounds[order[i]]);
+        centroidBounds.expand(bounds[order[i]].centroid());
+        nodePower += power[order[i]];
+    }
+    nodes[index].bounds = nodeBounds;
+    nodes[index].power = nodePower;
+
+    if (count == 1) {
+        nodes[index].leaf = true;
+        nodes[index].offset = order[first];
+        lightPaths[order[first]] = path;
+        return index;
+    }
+
+    int axis = centroidBounds.maxExtentAxis();
+    size_t mid = first + count / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count,
+                     [&](uint32_t a, uint32_t b) { return bounds[a].centroid()[axis] < bounds[b].centroid()[axis]; });
+
+    build(order, first, mid - first, bounds, power, path, depth + 1);
+    uint32_t right = build(order, mid, first + count - mid, bounds, power, path | (1ull << depth), depth + 1);
+    nodes[index].offset = right;
+    return index;
+}
+
+// Each child is weighted by its power over the squared distance to its center, with the
+// distance clamped to the child's own size so points inside a cluster do not blow up.
+float LightSampler::leftProbability(const glm::vec3& point, uint32_t node) const {
+    auto importance = [&point](const LightBVHNode& child) {
+        glm::vec3 toCenter = child.bounds.centroid() - point;
+        glm::vec3 halfExtent = child.bounds.extent() * 0.5f;
+        float distanceSquared = std::max(glm::dot(toCenter, toCenter), glm::dot(halfExtent, halfExtent));
+        return distanceSquared > 0.0f ? child.power / distanceSquared : child.power;
+    };
+    float left = importance(nodes[node + 1]);
+    float right = importance(nodes[nodes[node].offset]);
+    return left + right > 0.0f ? left / (left + right) : 0.5f;
+}
+
+uint32_t LightSampler::sample(const glm::vec3& point, float u, bool spatial, float& pmf) const {
+    pmf = 0.0f;
+    if (powerTable.empty())
+        return 0;
+    if (!spatial)
+        return powerTable.sample(u, pmf);
+
+    // Descend choosing one child per level, reusing what is left of u each time.
+    pmf = 1.0f;
+    uint32_t node = 0;
+    while (!nodes[node].leaf) {
+        float pLeft = leftProbability(point, node);
+        if (u < pLeft) {
+            u = std::min(u / pLeft, 0x1.fffffep-1f);
+            pmf *= pLeft;
+            node = node + 1;
+        } else {
+            u = std::min((u - pLeft) / (1.0f - pLeft), 0x1.fffffep-1f);
+            pmf *= 1.0f - pLeft;
+            node = nodes[node].offset;
+        }
+    }
+    return nodes[node].offset;
+}
+
+float LightSampler::pmf(const glm::vec3& point, uint32_t emitter, bool spatial) const {
+    if (!spatial || powerTable.pmf(emitter) <= 0.0f)
+        return powerTable.pmf(emitter);
+
+    float pmf = 1.0f;
+    uint32_t node = 0;
+    for (uint32_t depth = 0; !nodes[node].leaf; depth++) {
+        float pLeft = leftProbability(point, node);
+        if (lightPaths[emitter] & (1ull << depth)) {
+            pmf *= 1.0f - pLeft;
+            node = nodes[node].offset;
+        } else {
+            pmf *= pLeft;
+            node = node + 1;
+        }
+    }
+    return pmf;
+}
@@ -0,0 +1,69 @@
+//
+// Created by alex on 3/27/25.
+//
+
+// LightSampler.h
+#ifndef LIGHTSAMPLER_H
+#define LIGHTSAMPLER_H
+
+#include "AABB.h"
+#include "AliasTable.h"
+#include "Entity.h"
+#include "MaterialTable.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Node of the light BVH, stored depth-first like BVHNode: the left child of an interior
+// node is the next node, only the right child is stored.
+struct LightBVHNode {
+    AABB bounds;
+    float power = 0.0f;
+    uint32_t offset = 0;    // Leaf: emitter index. Interior: right child.
+    bool leaf = false;
+};
+
+// Picks the one light a shading point sends its shadow ray to. Every light part, such as
+// each triangle of an emissive mesh, is a separate emitter. Emitters are weighted by
+// emitted power, either globally through an alias table or, with the light BVH, also by
+// how close they are to the shading point. Either way the cost per shading point does
+// not grow with the number of emitters.
+class LightSampler {
+public:
+    // One part of one of Scene::lights. Emitters are numbered light by light, in part order.
+    struct Emitter {
+        uint32_t light = 0;   // Index in Scene::lights.
+        uint32_t part = 0;    // See Entity::lightPartCount.
+    };
+
+    LightSampler() = default;
+    LightSampler(const std::vector<std::shared_ptr<Entity>>& lights, const MaterialTable& materials);
+
+    bool empty() const { return powerTable.empty(); }
+
+    const Emitter& emitter(uint32_t index) const { return emitters[index]; }
+    size_t emitterCount() const { return emitters.size(); }
+
+    // Index of an emitter for point, chosen with u. pmf is set to the probability of that
+    // choice, 0 if there is nothing to sample.
+    uint32_t sample(const glm::vec3& point, float u, bool spatial, float& pmf) const;
+
+    // Probability that sample() picks emitter for point.
+    float pmf(const glm::vec3& point, uint32_t emitter, bool spatial) const;
+
+private:
+    std::vector<Emitter> emitters;
+    AliasTable powerTable;
+    std::vector<LightBVHNode> nodes;
+    std::vector<uint64_t> lightPaths;   // Per emitter: bit d set if its leaf is right of the depth d node.
+
+    uint32_t build(std::vector<uint32_t>& order, size_t first, size_t count,
+                   const std::vector<AABB>& bounds, const std::vector<float>& power,
+                   uint64_t path, uint32_t depth);
+
+    // Chance of descending into the left child of an interior node.
+    float leftProbability(const glm::vec3& point, uint32_t node) const;
+};
+
+#endif // LIGHTSAMPLER_H
@@ -0,0 +1,56 @@
+//
+// Created by alex on 3/25/25.
+//
+
+// MappedFile.cpp
+#include "MappedFile.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        std::cerr << "Cannot stat " << path << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return false;
+    }
+
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+        mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot map " << path << ": " << std::strerror(errno) << "\n";
+            mapping = nullptr;
+            length = 0;
+            ::close(fd);
+            return false;
+        }
+    }
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapping)
+        munmap(mapping, length);
+    mapping = nullptr;
+    length = 0;
+}
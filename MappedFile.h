@@ -0,0 +1,34 @@
+//
+// Created by alex on 3/25/25.
+//
+
+// MappedFile.h
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The pages are loaded by the OS on first
+// touch, so large files can be parsed in parallel without reading them up front.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps path; returns false and prints the reason if it cannot be opened.
+    bool open(const std::string& path);
+    void close();
+
+    const char* data() const { return static_cast<const char*>(mapping); }
+    size_t size() const { return length; }
+
+private:
+    void* mapping = nullptr;
+    size_t length = 0;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,24 @@
+//
+// Created by alex on 3/16/25.
+//
+
+// Material.h
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "SpectralData.h"
+#include "BSDF.h"
+
+// Shading data of a primitive. Kept apart from the geometry so intersection
+// tests never touch it; primitives refer to materials by their MaterialTable index.
+struct Material {
+    Spectrum color;
+    Spectrum emission;
+    BSDF* bsdf = nullptr;
+
+    bool isEmissive() const {
+        return emission > 0.0f;
+    }
+};
+
+#endif // MATERIAL_H
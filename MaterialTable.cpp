@@ -0,0 +1,49 @@
+//
+// Created by alex on 3/23/25.
+//
+
+// MaterialTable.cpp
+#include "MaterialTable.h"
+#include <cstring>
+
+uint32_t MaterialTable::add(const Material& material) {
+    uint64_t h = hash(material);
+    auto [first, last] = idsByHash.equal_range(h);
+    for (auto it = first; it != last; ++it) {
+        if (equal(materials[it->second], material))
+            return it->second;
+    }
+
+    uint32_t id = static_cast<uint32_t>(materials.size());
+    materials.push_back(material);
+    idsByHash.emplace(h, id);
+    return id;
+}
+
+void MaterialTable::clear() {
+    materials.clear();
+    idsByHash.clear();
+}
+
+// FNV-1a over the raw bytes of both spectra and the BSDF pointer. BSDFs are compared
+// by identity: materials share one only if they were given the same instance.
+uint64_t MaterialTable::hash(const Material& material) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    auto mix = [&h](const void* data, size_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            h ^= bytes[i];
+            h *= 0x100000001B3ull;
+        }
+    };
+    mix(material.color.samples.data(), sizeof(material.color.samples));
+    mix(material.emission.samples.data(), sizeof(material.emission.samples));
+    mix(&material.bsdf, sizeof(material.bsdf));
+    return h;
+}
+
+bool MaterialTable::equal(const Material& a, const Material& b) {
+    return a.bsdf == b.bsdf &&
+           std::memcmp(a.color.samples.data(), b.color.samples.data(), sizeof(a.color.samples)) == 0 &&
+           std::memcmp(a.emission.samples.data(), b.emission.samples.data(), sizeof(a.emission.samples)) == 0;
+}
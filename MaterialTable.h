@@ -0,0 +1,37 @@
+//
+// Created by alex on 3/23/25.
+//
+
+// MaterialTable.h
+#ifndef MATERIALTABLE_H
+#define MATERIALTABLE_H
+
+#include "Material.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Scene-wide list of distinct materials. Entities and primitives store a 32-bit
+// index into it instead of their own spectra; adding a material equal to one already
+// in the table returns the existing index.
+class MaterialTable {
+public:
+    uint32_t add(const Material& material);
+
+    const Material& operator[](uint32_t id) const { return materials[id]; }
+
+    size_t size() const { return materials.size(); }
+
+    const std::vector<Material>& getMaterials() const { return materials; }
+
+    void clear();
+
+private:
+    std::vector<Material> materials;
+    std::unordered_multimap<uint64_t, uint32_t> idsByHash;   // Content hash to candidate ids.
+
+    static uint64_t hash(const Material& material);
+    static bool equal(const Material& a, const Material& b);
+};
+
+#endif // MATERIALTABLE_H
@@ -0,0 +1,662 @@
+//
+// Created by alex on 3/25/25.
+//
+
+// MeshLoader.cpp
+#include "MeshLoader.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <omp.h>
+#include <sstream>
+
+namespace {
+
+// Files are split into about this many bytes per parallel chunk.
+constexpr size_t CHUNK_BYTES = 1 << 20;
+
+bool hasExtension(const std::string& path, const char* extension) {
+    size_t length = std::strlen(extension);
+    if (path.size() < length)
+        return false;
+    return std::equal(path.end() - length, path.end(), extension,
+                      [](char a, char b) { return std::tolower(a) == b; });
+}
+
+// Splits [data, data + size) into chunks that start at line beginnings.
+std::vector<const char*> splitLines(const char* data, size_t size) {
+    size_t chunkCount = std::clamp<size_t>(size / CHUNK_BYTES, 1, static_cast<size_t>(omp_get_max_threads()) * 8);
+    const char* end = data + size;
+    std::vector<const char*> bounds(chunkCount + 1, end);
+    bounds[0] = data;
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* p = std::max(bounds[i - 1], data + size / chunkCount * i);
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        bounds[i] = newline ? newline + 1 : end;
+    }
+    return bounds;
+}
+
+// ---------------------------------------------------------------------------
+// Wavefront OBJ
+
+const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+const char* lineEnd(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline ? newline : end;
+}
+
+bool parseFloat(const char*& p, const char* end, float& value) {
+    p = skipSpaces(p, end);
+    if (p < end && *p == '+')
+        p++;   // from_chars does not accept a leading plus sign.
+    auto [next, error] = std::from_chars(p, end, value);
+    if (error != std::errc())
+        return false;
+    p = next;
+    return true;
+}
+
+bool parseIndex(const char*& p, const char* end, long& value) {
+    auto [next, error] = std::from_chars(p, end, value);
+    if (error != std::errc())
+        return false;
+    p = next;
+    return true;
+}
+
+enum class ObjLine { Other, Position, Normal, UV, Face };
+
+// Classifies a line and moves p past its keyword.
+ObjLine classify(const char*& p, const char* end) {
+    p = skipSpaces(p, end);
+    auto isSpace = [&](const char* q) { return q < end && (*q == ' ' || *q == '\t'); };
+    if (p < end && *p == 'v') {
+        if (isSpace(p + 1)) { p += 1; return ObjLine::Position; }
+        if (p + 1 < end && p[1] == 'n' && isSpace(p + 2)) { p += 2; return ObjLine::Normal; }
+        if (p + 1 < end && p[1] == 't' && isSpace(p + 2)) { p += 2; return ObjLine::UV; }
+    } else if (p < end && *p == 'f' && isSpace(p + 1)) {
+        p += 1;
+        return ObjLine::Face;
+    }
+    return ObjLine::Other;
+}
+
+// Counts of one chunk from the first pass; turned into output offsets before the second.
+struct ObjChunk {
+    size_t positions = 0, normals = 0, uvs = 0, triangles = 0;
+    bool valid = true;
+    bool normalsMatch = true;   // Every corner's normal index equals its position index.
+    bool uvsMatch = true;       // Every corner's uv index equals its position index.
+};
+
+void countChunk(const char* p, const char* end, ObjChunk& chunk) {
+    while (p < end) {
+        const char* eol = lineEnd(p, end);
+        switch (classify(p, eol)) {
+            case ObjLine::Position: chunk.positions++; break;
+            case ObjLine::Normal: chunk.normals++; break;
+            case ObjLine::UV: chunk.uvs++; break;
+            case ObjLine::Face: {
+                size_t corners = 0;
+                for (p = skipSpaces(p, eol); p < eol && *p != '\r' && *p != '#'; p = skipSpaces(p, eol)) {
+                    corners++;
+                    while (p < eol && *p != ' ' && *p != '\t' && *p != '\r')
+                        p++;
+                }
+                if (corners >= 3)
+                    chunk.triangles += corners - 2;
+                break;
+            }
+            case ObjLine::Other: break;
+        }
+        p = eol + 1;
+    }
+}
+
+// Resolves a 1-based or negative (relative) OBJ index against the count seen so far.
+// OBJ has no index 0, so it resolves to -1 like any other index out of range.
+long resolveIndex(long index, size_t countSoFar) {
+    if (index == 0)
+        return -1;
+    return index > 0 ? index - 1 : static_cast<long>(countSoFar) + index;
+}
+
+void parseChunk(const char* p, const char* end, const ObjChunk& base, ObjChunk& chunk,
+                size_t totalPositions, MeshData& mesh,
+                std::vector<glm::vec3>& normals, std::vector<glm::vec2>& uvs) {
+    size_t positions = base.positions, normalCount = base.normals, uvCount = base.uvs, triangles = base.triangles;
+
+    while (p < end && chunk.valid) {
+        const char* eol = lineEnd(p, end);
+        switch (classify(p, eol)) {
+            case ObjLine::Position: {
+                glm::vec3& v = mesh.positions[positions++];
+                chunk.valid = parseFloat(p, eol, v.x) && parseFloat(p, eol, v.y) && parseFloat(p, eol, v.z);
+                break;
+            }
+            case ObjLine::Normal: {
+                glm::vec3& n = normals[normalCount++];
+                chunk.valid = parseFloat(p, eol, n.x) && parseFloat(p, eol, n.y) && parseFloat(p, eol, n.z);
+                break;
+            }
+            case ObjLine::UV: {
+                glm::vec2& t = uvs[uvCount++];
+                chunk.valid = parseFloat(p, eol, t.x) && parseFloat(p, eol, t.y);
+                break;
+            }
+            case ObjLine::Face: {
+                uint32_t first = 0, previous = 0;
+                int corner = 0;
+                for (p = skipSpaces(p, eol); p < eol && *p != '\r' && *p != '#'; p = skipSpaces(p, eol), corner++) {
+                    long v, t = 0, n = 0;
+                    bool hasUV = false, hasNormal = false;
+                    if (!parseIndex(p, eol, v)) { chunk.valid = false; break; }
+                    if (p < eol && *p == '/') {
+                        p++;
+                        if (p < eol && *p != '/') {
+                            if (!parseIndex(p, eol, t)) { chunk.valid = false; break; }
+                            hasUV = true;
+                        }
+                        if (p < eol && *p == '/') {
+                            p++;
+                            if (!parseIndex(p, eol, n)) { chunk.valid = false; break; }
+                            hasNormal = true;
+                        }
+                    }
+
+                    long position = resolveIndex(v, positions);
+                    if (position < 0 || static_cast<size_t>(position) >= totalPositions) {
+                        chunk.valid = false;
+                        break;
+                    }
+                    chunk.uvsMatch &= hasUV && resolveIndex(t, uvCount) == position;
+                    chunk.normalsMatch &= hasNormal && resolveIndex(n, normalCount) == position;
+
+                    uint32_t index = static_cast<uint32_t>(position);
+                    if (corner == 0) {
+                        first = index;
+                    } else if (corner >= 2) {
+                        uint32_t* out = &mesh.indices[triangles++ * 3];
+                        out[0] = first;
+                        out[1] = previous;
+                        out[2] = index;
+                    }
+                    previous = index;
+                }
+                break;
+            }
+            case ObjLine::Other: break;
+        }
+        p = eol + 1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Binary PLY
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+PlyType parsePlyType(const std::string& name) {
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+size_t plySize(PlyType type) {
+    switch (type) {
+        case PlyType::Int8: case PlyType::UInt8: return 1;
+        case PlyType::Int16: case PlyType::UInt16: return 2;
+        case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+        case PlyType::Float64: return 8;
+        default: return 0;
+    }
+}
+
+// True if count records of stride bytes fit in available bytes, without overflowing count * stride.
+bool plyRecordsFit(size_t count, size_t stride, size_t available) {
+    return stride == 0 || count <= available / stride;
+}
+
+// Reads one little-endian value; the file data has no alignment guarantees.
+template <typename T>
+T readRaw(const char* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+double readPly(const char* p, PlyType type) {
+    switch (type) {
+        case PlyType::Int8: return readRaw<int8_t>(p);
+        case PlyType::UInt8: return readRaw<uint8_t>(p);
+        case PlyType::Int16: return readRaw<int16_t>(p);
+        case PlyType::UInt16: return readRaw<uint16_t>(p);
+        case PlyType::Int32: return readRaw<int32_t>(p);
+        case PlyType::UInt32: return readRaw<uint32_t>(p);
+        case PlyType::Float32: return readRaw<float>(p);
+        case PlyType::Float64: return readRaw<double>(p);
+        default: return 0.0;
+    }
+}
+
+int64_t readPlyIndex(const char* p, PlyType type) {
+    switch (type) {
+        case PlyType::Int8: return readRaw<int8_t>(p);
+        case PlyType::UInt8: return readRaw<uint8_t>(p);
+        case PlyType::Int16: return readRaw<int16_t>(p);
+        case PlyType::UInt16: return readRaw<uint16_t>(p);
+        case PlyType::Int32: return readRaw<int32_t>(p);
+        case PlyType::UInt32: return readRaw<uint32_t>(p);
+        default: return -1;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;       // Value type, or index type for lists.
+    PlyType countType = PlyType::Invalid;  // Only set for lists.
+    size_t offset = 0;                     // Byte offset in a record without lists before it.
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+    bool hasList = false;
+    size_t stride = 0;                     // Record size when there is no list.
+
+    int find(std::initializer_list<const char*> names) const {
+        for (size_t i = 0; i < properties.size(); i++)
+            for (const char* name : names)
+                if (properties[i].name == name)
+                    return static_cast<int>(i);
+        return -1;
+    }
+};
+
+// Size of the record at p, or 0 if it runs past end.
+size_t plyRecordSize(const PlyElement& element, const char* p, const char* end) {
+    const char* start = p;
+    for (const PlyProperty& property : element.properties) {
+        if (property.countType != PlyType::Invalid) {
+            if (p + plySize(property.countType) > end)
+                return 0;
+            int64_t count = readPlyIndex(p, property.countType);
+            p += plySize(property.countType) + std::max<int64_t>(count, 0) * plySize(property.type);
+        } else {
+            p += plySize(property.type);
+        }
+        if (p > end)
+            return 0;
+    }
+    return static_cast<size_t>(p - start);
+}
+
+bool parsePlyHeader(const char* data, size_t size, std::vector<PlyElement>& elements, size_t& bodyOffset) {
+    static const char END_HEADER[] = "end_header";
+    const char* end = data + size;
+    const char* marker = std::search(data, end, END_HEADER, END_HEADER + sizeof(END_HEADER) - 1);
+    if (marker == end)
+        return false;
+    const char* newline = static_cast<const char*>(std::memchr(marker, '\n', end - marker));
+    if (!newline)
+        return false;
+    bodyOffset = static_cast<size_t>(newline + 1 - data);
+
+    std::istringstream header(std::string(data, marker));
+    std::string line;
+    bool littleEndian = false;
+    while (std::getline(header, line)) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            tokens >> format;
+            littleEndian = format == "binary_little_endian";
+        } else if (keyword == "element") {
+            PlyElement element;
+            tokens >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            PlyElement& element = elements.back();
+            PlyProperty property;
+            std::string type;
+            tokens >> type;
+            if (type == "list") {
+                std::string countType, indexType;
+                tokens >> countType >> indexType;
+                property.countType = parsePlyType(countType);
+                property.type = parsePlyType(indexType);
+                if (property.countType == PlyType::Invalid)
+                    return false;
+                element.hasList = true;
+            } else {
+                property.type = parsePlyType(type);
+                property.offset = element.stride;
+                element.stride += plySize(property.type);
+            }
+            if (property.type == PlyType::Invalid)
+                return false;
+            tokens >> property.name;
+            element.properties.push_back(property);
+        }
+    }
+
+    if (!littleEndian) {
+        std::cerr << "Only binary_little_endian PLY files are supported\n";
+        return false;
+    }
+    return true;
+}
+
+bool readPlyVertices(const PlyElement& element, const char* body, MeshData& mesh) {
+    int x = element.find({ "x" }), y = element.find({ "y" }), z = element.find({ "z" });
+    if (x < 0 || y < 0 || z < 0)
+        return false;
+    int nx = element.find({ "nx" }), ny = element.find({ "ny" }), nz = element.find({ "nz" });
+    int u = element.find({ "u", "s", "texture_u", "texture_s" });
+    int v = element.find({ "v", "t", "texture_v", "texture_t" });
+    bool hasNormals = nx >= 0 && ny >= 0 && nz >= 0;
+    bool hasUVs = u >= 0 && v >= 0;
+
+    const auto& props = element.properties;
+    mesh.positions.resize(element.count);
+    if (hasNormals)
+        mesh.normals.resize(element.count);
+    if (hasUVs)
+        mesh.uvs.resize(element.count);
+
+    auto read = [&](const char* record, int property) {
+        return static_cast<float>(readPly(record + props[property].offset, props[property].type));
+    };
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < element.count; i++) {
+        const char* record = body + i * element.stride;
+        mesh.positions[i] = glm::vec3(read(record, x), read(record, y), read(record, z));
+        if (hasNormals)
+            mesh.normals[i] = glm::vec3(read(record, nx), read(record, ny), read(record, nz));
+        if (hasUVs)
+            mesh.uvs[i] = glm::vec2(read(record, u), read(record, v));
+    }
+    return true;
+}
+
+// Decodes the face element. Meshes made only of triangles have a fixed record size
+// and are decoded in parallel; anything else is walked record by record.
+bool readPlyFaces(const PlyElement& element, const char* body, const char* end, MeshData& mesh) {
+    int list = element.find({ "vertex_indices", "vertex_index" });
+    if (list < 0 || element.properties[list].countType == PlyType::Invalid)
+        return false;
+    const PlyProperty& indices = element.properties[list];
+    const size_t countSize = plySize(indices.countType);
+    const size_t indexSize = plySize(indices.type);
+    const int64_t vertexCount = static_cast<int64_t>(mesh.positions.size());
+
+    // Layout every record would have if all faces were triangles.
+    size_t listOffset = 0, stride = 0;
+    for (size_t i = 0; i < element.properties.size(); i++) {
+        const PlyProperty& property = element.properties[i];
+        if (static_cast<int>(i) == list)
+            listOffset = stride;
+        if (property.countType != PlyType::Invalid)
+            stride += plySize(property.countType) + 3 * (static_cast<int>(i) == list ? indexSize : plySize(property.type));
+        else
+            stride += plySize(property.type);
+    }
+    bool onlyOneList = std::count_if(element.properties.begin(), element.properties.end(),
+        [](const PlyProperty& p) { return p.countType != PlyType::Invalid; }) == 1;
+
+    bool allTriangles = onlyOneList && plyRecordsFit(element.count, stride, static_cast<size_t>(end - body));
+    if (allTriangles) {
+        #pragma omp parallel for reduction(&& : allTriangles) schedule(static)
+        for (size_t i = 0; i < element.count; i++)
+            allTriangles = allTriangles && readPlyIndex(body + i * stride + listOffset, indices.countType) == 3;
+    }
+
+    if (allTriangles) {
+        mesh.indices.resize(element.count * 3);
+        bool valid = true;
+        #pragma omp parallel for reduction(&& : valid) schedule(static)
+        for (size_t i = 0; i < element.count; i++) {
+            const char* p = body + i * stride + listOffset + countSize;
+            for (int k = 0; k < 3; k++) {
+                int64_t index = readPlyIndex(p + k * indexSize, indices.type);
+                valid = valid && index >= 0 && index < vertexCount;
+                mesh.indices[i * 3 + k] = static_cast<uint32_t>(index);
+            }
+        }
+        return valid;
+    }
+
+    // General polygons: walk the records and fan-triangulate.
+    const char* p = body;
+    for (size_t face = 0; face < element.count; face++) {
+        const char* record = p;
+        size_t size = plyRecordSize(element, record, end);
+        if (size == 0)
+            return false;
+        p += size;
+
+        const char* cursor = record;
+        for (size_t i = 0; i < element.properties.size(); i++) {
+            const PlyProperty& property = element.properties[i];
+            if (property.countType == PlyType::Invalid) {
+                cursor += plySize(property.type);
+                continue;
+            }
+            int64_t count = readPlyIndex(cursor, property.countType);
+            cursor += plySize(property.countType);
+            if (static_cast<int>(i) == list) {
+                for (int64_t k = 2; k < count; k++) {
+                    int64_t corners[3] = {
+                        readPlyIndex(cursor, property.type),
+                        readPlyIndex(cursor + (k - 1) * indexSize, property.type),
+                        readPlyIndex(cursor + k * indexSize, property.type)
+                    };
+                    for (int64_t index : corners) {
+                        if (index < 0 || index >= vertexCount)
+                            return false;
+                        mesh.indices.push_back(static_cast<uint32_t>(index));
+                    }
+                }
+            }
+            cursor += std::max<int64_t>(count, 0) * plySize(property.type);
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// XYZR sphere lists
+
+// Parses the spheres of one chunk; returns false at the first malformed line.
+// Columns after the radius, such as the atom names of XYZRN files, are ignored.
+bool parseSphereChunk(const char* p, const char* end, SphereData& spheres) {
+    while (p < end) {
+        const char* eol = lineEnd(p, end);
+        p = skipSpaces(p, eol);
+        if (p < eol && *p != '#' && *p != '\r') {
+            glm::vec3 center;
+            float radius;
+            if (!parseFloat(p, eol, center.x) || !parseFloat(p, eol, center.y) || !parseFloat(p, eol, center.z) ||
+                !parseFloat(p, eol, radius) || !(radius > 0.0f))
+                return false;
+            spheres.centers.push_back(center);
+            spheres.radii.push_back(radius);
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+bool loadMesh(const std::string& path, MeshData& mesh) {
+    if (hasExtension(path, ".obj"))
+        return loadOBJ(path, mesh);
+    if (hasExtension(path, ".ply"))
+        return loadPLY(path, mesh);
+    std::cerr << "Unsupported mesh format: " << path << "\n";
+    return false;
+}
+
+bool loadOBJ(const std::string& path, MeshData& mesh) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    const char* data = file.data();
+    std::vector<const char*> bounds = splitLines(data, file.size());
+    const size_t chunkCount = bounds.size() - 1;
+
+    // First pass: count every kind of line per chunk.
+    std::vector<ObjChunk> chunks(chunkCount);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < chunkCount; i++)
+        countChunk(bounds[i], bounds[i + 1], chunks[i]);
+
+    // Prefix sums give every chunk the place its output starts at.
+    std::vector<ObjChunk> bases(chunkCount);
+    ObjChunk total;
+    for (size_t i = 0; i < chunkCount; i++) {
+        bases[i] = total;
+        total.positions += chunks[i].positions;
+        total.normals += chunks[i].normals;
+        total.uvs += chunks[i].uvs;
+        total.triangles += chunks[i].triangles;
+    }
+
+    mesh = MeshData();
+    mesh.positions.resize(total.positions);
+    mesh.indices.resize(total.triangles * 3);
+    std::vector<glm::vec3> normals(total.normals);
+    std::vector<glm::vec2> uvs(total.uvs);
+
+    // Second pass: parse straight into the final buffers.
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < chunkCount; i++)
+        parseChunk(bounds[i], bounds[i + 1], bases[i], chunks[i], total.positions, mesh, normals, uvs);
+
+    bool normalsMatch = total.normals == total.positions;
+    bool uvsMatch = total.uvs == total.positions;
+    for (const ObjChunk& chunk : chunks) {
+        if (!chunk.valid) {
+            std::cerr << "Malformed OBJ file: " << path << "\n";
+            mesh = MeshData();
+            return false;
+        }
+        normalsMatch &= chunk.normalsMatch;
+        uvsMatch &= chunk.uvsMatch;
+    }
+
+    // TriangleMesh has one index per corner, so attributes are only kept when
+    // the file indexes them the same way as the positions.
+    if (normalsMatch)
+        mesh.normals = std::move(normals);
+    if (uvsMatch)
+        mesh.uvs = std::move(uvs);
+    return true;
+}
+
+bool loadPLY(const std::string& path, MeshData& mesh) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    std::vector<PlyElement> elements;
+    size_t bodyOffset = 0;
+    if (!parsePlyHeader(file.data(), file.size(), elements, bodyOffset)) {
+        std::cerr << "Malformed PLY header: " << path << "\n";
+        return false;
+    }
+
+    mesh = MeshData();
+    const char* p = file.data() + bodyOffset;
+    const char* end = file.data() + file.size();
+    bool haveVertices = false, haveFaces = false;
+
+    for (const PlyElement& element : elements) {
+        if (element.name == "vertex") {
+            if (element.hasList || !plyRecordsFit(element.count, element.stride, static_cast<size_t>(end - p)) ||
+                !readPlyVertices(element, p, mesh)) {
+                std::cerr << "Unsupported or truncated PLY vertex data: " << path << "\n";
+                return false;
+            }
+            p += element.count * element.stride;
+            haveVertices = true;
+        } else if (element.name == "face") {
+            if (!haveVertices || !readPlyFaces(element, p, end, mesh)) {
+                std::cerr << "Unsupported or malformed PLY face data: " << path << "\n";
+                mesh = MeshData();
+                return false;
+            }
+            haveFaces = true;
+            break;   // Nothing after the faces is needed.
+        } else {
+            // Skip elements the renderer has no use for.
+            for (size_t i = 0; i < element.count; i++) {
+                size_t size = plyRecordSize(element, p, end);
+                if (size == 0) {
+                    std::cerr << "Truncated PLY file: " << path << "\n";
+                    return false;
+                }
+                p += size;
+            }
+        }
+    }
+
+    if (!haveFaces) {
+        std::cerr << "PLY file has no faces: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool loadSpheres(const std::string& path, SphereData& spheres) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    std::vector<const char*> bounds = splitLines(file.data(), file.size());
+    const size_t chunkCount = bounds.size() - 1;
+    std::vector<SphereData> chunks(chunkCount);
+    std::vector<uint8_t> valid(chunkCount);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < chunkCount; i++)
+        valid[i] = parseSphereChunk(bounds[i], bounds[i + 1], chunks[i]);
+
+    size_t total = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (!valid[i]) {
+            std::cerr << "Malformed sphere file: " << path << "\n";
+            return false;
+        }
+        total += chunks[i].centers.size();
+    }
+
+    spheres = SphereData();
+    spheres.centers.reserve(total);
+    spheres.radii.reserve(total);
+    for (const SphereData& chunk : chunks) {
+        spheres.centers.insert(spheres.centers.end(), chunk.centers.begin(), chunk.centers.end());
+        spheres.radii.insert(spheres.radii.end(), chunk.radii.begin(), chunk.radii.end());
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+//
+// Created by alex on 3/25/25.
+//
+
+// MeshLoader.h
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Vertex and index buffers as read from a file, ready to be moved into a TriangleMesh.
+// normals and uvs are either empty or hold one entry per position.
+struct MeshData {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+};
+
+// Sphere centers and radii as read from a file, ready to be moved into a SphereSet.
+struct SphereData {
+    std::vector<glm::vec3> centers;
+    std::vector<float> radii;
+};
+
+// Loads a Wavefront OBJ or binary PLY file, chosen by extension. The file is memory
+// mapped and parsed in parallel chunks; polygons are fan-triangulated.
+// Returns false and prints the reason if the file cannot be read.
+bool loadMesh(const std::string& path, MeshData& mesh);
+
+bool loadOBJ(const std::string& path, MeshData& mesh);
+bool loadPLY(const std::string& path, MeshData& mesh);
+
+// Loads an XYZR text file, one sphere per line as "x y z radius", the way molecular
+// surface tools write atoms. Blank lines and lines starting with '#' are skipped.
+bool loadSpheres(const std::string& path, SphereData& spheres);
+
+#endif // MESHLOADER_H
@@ -0,0 +1,244 @@
+//
+// Created by alex on 3/29/25.
+//
+
+// PathIntegrator.h
+#ifndef PATHINTEGRATOR_H
+#define PATHINTEGRATOR_H
+
+#include "Constants.h"
+#include "Renderer.h"
+#include "SamplingHelpers.h"
+#include "Scene.h"
+#include "SpectralData.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+
+// Building blocks shared by the integrators in Renderer.cpp and WavefrontIntegrator.cpp.
+// Both shade vertices with shadeVertex and draw random numbers in the same order, so
+// for a given sample they trace the same path; they only differ in how rays are batched.
+
+// Paths that carry every bin of the spectrum.
+struct FullSpectrumPath {
+    using PathSpectrum = Spectrum;
+
+    static FullSpectrumPath sample(Sampler&) { return {}; }
+
+    const Spectrum& project(const Spectrum& spectrum) const { return spectrum; }
+
+    Spectrum evaluateBSDF(const BSDF& bsdf, const glm::vec3& wi, const glm::vec3& wo, const glm::vec3& normal) const {
+        return bsdf.evaluate(wi, wo, normal);
+    }
+
+    BSDFSample sampleBSDF(const BSDF& bsdf, const glm::vec3& wi, const glm::vec3& normal, Sampler& sampler) const {
+        return bsdf.sample(wi, normal, sampler);
+    }
+
+    void splat(Spectrum& pixel, const Spectrum& radiance) const { pixel += radiance; }
+};
+
+// Paths that carry HERO_WAVELENGTHS stratified bins. A bin is traced by a fraction
+// HERO_WAVELENGTHS / SPECTRAL_SAMPLES of the paths, so splatting with the inverse
+// of that fraction keeps the pixel's spectrum unbiased.
+struct HeroWavelengthPath {
+    using PathSpectrum = SampledSpectrum;
+
+    SampledWavelengths wavelengths;
+
+    static HeroWavelengthPath sample(Sampler& sampler) {
+        return { SampledWavelengths::sampleStratified(sampler.get1D()) };
+    }
+
+    SampledSpectrum project(const Spectrum& spectrum) const { return spectrum.sample(wavelengths); }
+
+    // The BSDF is only evaluated at the path's bins, never over the whole spectrum.
+    SampledSpectrum evaluateBSDF(const BSDF& bsdf, const glm::vec3& wi, const glm::vec3& wo,
+                                 const glm::vec3& normal) const {
+        return bsdf.evaluate(wi, wo, normal, wavelengths);
+    }
+
+    SampledBSDFSample sampleBSDF(const BSDF& bsdf, const glm::vec3& wi, const glm::vec3& normal,
+                                 Sampler& sampler) const {
+        return bsdf.sample(wi, normal, wavelengths, sampler);
+    }
+
+    void splat(Spectrum& pixel, const SampledSpectrum& radiance) const {
+        pixel.splat(wavelengths, radiance, static_cast<float>(SPECTRAL_SAMPLES) / HERO_WAVELENGTHS);
+    }
+};
+
+// Everything a path carries from one bounce to the next. origin and dir are the ray
+// still to be traced.
+template <typename Path>
+struct PathState {
+    using PathSpectrum = typename Path::PathSpectrum;
+
+    Path path;
+    PathSpectrum radiance = PathSpectrum(0.0f);
+    PathSpectrum throughput = PathSpectrum(1.0f);
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 dir = glm::vec3(0.0f);
+    int depth = 0;
+
+    // Solid angle density of the bounce that produced dir, or 0 for camera rays, whose
+    // emitter hits light sampling could not have found.
+    float bsdfPdf = 0.0f;
+    glm::vec3 bsdfOrigin = glm::vec3(0.0f);
+};
+
+// Surfaces without a BSDF are diffuse with their material colour, f = color / pi, and
+// bounce with random_in_hemisphere, which has this density.
+constexpr float UNIFORM_HEMISPHERE_PDF = static_cast<float>(0.5 / M_PI);
+
+// Shadow ray towards a light sample. contribution already includes the path throughput
+// and is added to the path's radiance if nothing blocks the ray.
+template <typename PathSpectrum>
+struct ShadowRay {
+    glm::vec3 origin;
+    glm::vec3 dir;
+    float tMax;
+    PathSpectrum contribution;
+    bool pending = false;
+};
+
+// Jittered camera ray through pixel (x, y); uses the first two dimensions of sampler.
+inline glm::vec3 cameraRayDirection(const Camera& camera, int x, int y, int width, int height,
+                                    float scale, Sampler& sampler) {
+    const float aspectRatio = static_cast<float>(width) / height;
+    float offsetX = sampler.get1D();
+    float offsetY = sampler.get1D();
+    float imageX = (2.0f * ((x + offsetX) / (float)width) - 1.0f) * aspectRatio * scale;
+    float imageY = (1.0f - 2.0f * ((y + offsetY) / (float)height)) * scale;
+    return glm::normalize(camera.forward + camera.right * imageX + camera.up * imageY);
+}
+
+// Shades the vertex the path's current ray reached (hit, if hitSomething is set): adds
+// emission and ambient light to the radiance, prepares the shadow ray of one light sample
+// and samples the next ray. Returns false once the path has ended.
+template <typename Path>
+bool shadeVertex(PathState<Path>& state,
+                 bool hitSomething,
+                 const HitRecord& hit,
+                 const Scene& scene,
+                 const RenderSettings& settings,
+                 int maxDepth,
+                 Sampler& sampler,
+                 ShadowRay<typename Path::PathSpectrum>& shadow) {
+    using PathSpectrum = typename Path::PathSpectrum;
+    const Path& path = state.path;
+    const float shadowBias = settings.shadowBias;
+    shadow.pending = false;
+
+    if (!hitSomething) {
+        state.radiance.addProduct(state.throughput, path.project(backgroundSpectrum));
+        return false;
+    }
+
+    const Material& material = scene.materials[hit.materialId];
+
+    // Direct hit on an emissive surface. After a BSDF bounce, light sampling at the
+    // previous vertex could have found the same point, so the hit only gets its MIS share.
+    if (material.isEmissive()) {
+        float weight = 1.0f;
+        if (state.bsdfPdf > 0.0f && hit.lightIndex != HitRecord::NO_LIGHT) {
+            const LightSampler::Emitter& emitter = scene.lightSampler.emitter(hit.lightIndex);
+            const Entity& light = *scene.lights[emitter.light];
+            float lightPdf = scene.lightSampler.pmf(state.bsdfOrigin, hit.lightIndex, settings.lightBVH) *
+                             light.pdfPart(emitter.part, state.bsdfOrigin, hit.hitPoint, hit.normal);
+            weight = powerHeuristic(state.bsdfPdf, lightPdf);
+        }
+        state.radiance.addProduct(state.throughput, path.project(material.emission), weight);
+        return false;
+    }
+
+    // Start with ambient light.
+    const auto& color = path.project(material.color);
+    state.radiance.addProduct(state.throughput, color, 0.1f);  // Ambient term
+    const BSDF* bsdf = material.bsdf;
+    const glm::vec3 wi = -state.dir;
+
+    // No bounce is traced from the last vertex, so its light sample is the only estimate.
+    const bool lastVertex = state.depth >= maxDepth;
+
+    // One shadow ray per shading point, to a light chosen by the scene's light sampler.
+    float lightPick;
+    uint32_t emitterIndex = scene.lightSampler.sample(hit.hitPoint, sampler.get1D(), settings.lightBVH, lightPick);
+    if (lightPick > 0.0f) {
+        const LightSampler::Emitter& emitter = scene.lightSampler.emitter(emitterIndex);
+        const Entity& light = *scene.lights[emitter.light];
+        glm::vec3 samplePoint, lightNormal;
+        float pdf;
+        light.samplePart(emitter.part, hit.hitPoint, sampler, samplePoint, lightNormal, pdf);
+        pdf *= lightPick;
+
+        glm::vec3 lightDir = glm::normalize(samplePoint - hit.hitPoint);
+
+        // Light sample weighted against the chance of the bounce sampling the same direction.
+        float lightPdf = pdf > 0.0f ? areaToSolidAnglePdf(pdf, hit.hitPoint, samplePoint, lightNormal) : 0.0f;
+        if (lightPdf > 0.0f) {
+            float cosTheta = std::max(0.0f, glm::dot(hit.normal, lightDir));
+            const Spectrum& emission = scene.materials[light.getMaterialId()].emission;
+            float weight = 1.0f;
+            if (!lastVertex) {
+                float bouncePdf = bsdf ? bsdf->pdf(wi, lightDir, hit.normal) : UNIFORM_HEMISPHERE_PDF;
+                weight = powerHeuristic(lightPdf, bouncePdf);
+            }
+            PathSpectrum f = bsdf ? path.evaluateBSDF(*bsdf, wi, lightDir, hit.normal)
+                                  : color * static_cast<float>(1.0 / M_PI);
+            PathSpectrum direct(0.0f);
+            direct.addProduct(f, path.project(emission), cosTheta * weight / lightPdf);
+            shadow.pending = true;
+
+            // Aim from the biased origin at the sample point and stop short of it, so the
+            // light's own surface never counts as a blocker.
+            shadow.origin = hit.hitPoint + hit.normal * shadowBias;
+            glm::vec3 toLight = samplePoint - shadow.origin;
+            float shadowDistance = glm::length(toLight);
+            shadow.dir = toLight / shadowDistance;
+            shadow.tMax = shadowDistance - shadowBias;
+            shadow.contribution = state.throughput;
+            shadow.contribution *= direct;
+        }
+    }
+
+    if (lastVertex)
+        return false;
+
+    // Use BSDF for the indirect bounce.
+    glm::vec3 newDir;
+
+    if (bsdf) {
+        auto bsdfSample = path.sampleBSDF(*bsdf, wi, hit.normal, sampler);
+        if (bsdfSample.pdf <= 0.0f)
+            return false;
+
+        // The sample weight already holds f * cos / pdf.
+        newDir = bsdfSample.direction;
+        state.throughput *= bsdfSample.weight;
+        state.bsdfPdf = bsdfSample.pdf;
+    } else {
+        // Fallback: the diffuse lobe sampled uniformly, so the weight f * cos / pdf is 2 * color * cos.
+        newDir = random_in_hemisphere(hit.normal, sampler);
+        float cosTheta = std::max(0.0f, glm::dot(hit.normal, newDir));
+        state.throughput.mulScaled(color, cosTheta * static_cast<float>(1.0 / M_PI) / UNIFORM_HEMISPHERE_PDF);
+        state.bsdfPdf = UNIFORM_HEMISPHERE_PDF;
+    }
+
+    state.bsdfOrigin = hit.hitPoint;
+    state.origin = hit.hitPoint + hit.normal * shadowBias;
+    state.dir = newDir;
+
+    // Russian roulette: past minDepth, continue with a probability that follows the
+    // throughput and reweight survivors, so dim paths stop early without bias.
+    if (state.depth + 1 >= settings.minDepth) {
+        float survival = std::min(state.throughput.maxValue(), 0.95f);
+        if (sampler.get1D() >= survival)
+            return false;
+        state.throughput /= survival;
+    }
+
+    state.depth++;
+    return true;
+}
+
+#endif // PATHINTEGRATOR_H
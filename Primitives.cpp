@@ -0,0 +1,435 @@
+//
+// Created by alex on 3/16/25.
+//
+
+// Primitives.cpp
+#include "Primitives.h"
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+template <typename T>
+void permuteArray(Buffer<T>& values, const std::vector<uint32_t>& order, uint32_t first) {
+    std::vector<T> permuted(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+        permuted[i] = values[first + order[i]];
+    if (first == 0 && permuted.size() == values.size())
+        values = Buffer<T>(std::move(permuted));
+    else
+        std::copy(permuted.begin(), permuted.end(), values.values().begin() + first);
+}
+
+#if defined(__AVX__)
+// LANE_MASKS + 8 - n enables the first n lanes of a masked load.
+alignas(32) const int32_t LANE_MASKS[16] = { -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+// Fused where the CPU allows it. The rounding saved matters: shadow rays stop only
+// shadowBias short of the light, and a t that comes out a little short there counts
+// the light itself as a blocker.
+#if defined(__FMA__)
+inline __m256 dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+    return _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx)));
+}
+
+// a * b - c * d
+inline __m256 cross8(__m256 a, __m256 b, __m256 c, __m256 d) {
+    return _mm256_fmsub_ps(a, b, _mm256_mul_ps(c, d));
+}
+
+// c - a * b
+inline __m256 negMulAdd8(__m256 a, __m256 b, __m256 c) {
+    return _mm256_fnmadd_ps(a, b, c);
+}
+#else
+inline __m256 dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+
+inline __m256 cross8(__m256 a, __m256 b, __m256 c, __m256 d) {
+    return _mm256_sub_ps(_mm256_mul_ps(a, b), _mm256_mul_ps(c, d));
+}
+
+inline __m256 negMulAdd8(__m256 a, __m256 b, __m256 c) {
+    return _mm256_sub_ps(c, _mm256_mul_ps(a, b));
+}
+#endif
+
+// intersectTriangle for the n <= 8 triangles of the pool starting at first, all at once.
+// Returns the mask of triangles hit before tMax and writes their distances to t.
+uint32_t intersectTriangles8(const TrianglePool& pool, uint32_t first, uint32_t n,
+                             const glm::vec3& origin, const glm::vec3& dir, float tMax, float* t) {
+    // Masked loads, so a group at the end of the pool does not read past it. Disabled
+    // lanes load zeros, which the determinant test rejects.
+    const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(LANE_MASKS + 8 - n));
+    auto load = [&](const Buffer<float>& values) { return _mm256_maskload_ps(values.data() + first, lanes); };
+    const __m256 e1x = load(pool.e1x), e1y = load(pool.e1y), e1z = load(pool.e1z);
+    const __m256 e2x = load(pool.e2x), e2y = load(pool.e2y), e2z = load(pool.e2z);
+    const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+
+    // h = dir x edge2, a = edge1 . h
+    const __m256 hx = cross8(dy, e2z, dz, e2y);
+    const __m256 hy = cross8(dz, e2x, dx, e2z);
+    const __m256 hz = cross8(dx, e2y, dy, e2x);
+    const __m256 a = dot8(e1x, e1y, e1z, hx, hy, hz);
+    const __m256 f = _mm256_div_ps(_mm256_set1_ps(1.0f), a);
+
+    // s = origin - v0, q = s x edge1
+    const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(origin.x), load(pool.v0x));
+    const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(origin.y), load(pool.v0y));
+    const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(origin.z), load(pool.v0z));
+    const __m256 qx = cross8(sy, e1z, sz, e1y);
+    const __m256 qy = cross8(sz, e1x, sx, e1z);
+    const __m256 qz = cross8(sx, e1y, sy, e1x);
+
+    const __m256 u = _mm256_mul_ps(f, dot8(sx, sy, sz, hx, hy, hz));
+    const __m256 v = _mm256_mul_ps(f, dot8(dx, dy, dz, qx, qy, qz));
+    const __m256 tHit = _mm256_mul_ps(f, dot8(e2x, e2y, e2z, qx, qy, qz));
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 epsilon = _mm256_set1_ps(TRIANGLE_EPSILON);
+    const __m256 absA = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+    __m256 valid = _mm256_cmp_ps(absA, epsilon, _CMP_GE_OQ);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(tHit, epsilon, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(tHit, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(t, tHit);
+    return static_cast<uint32_t>(_mm256_movemask_ps(valid)) & ((1u << n) - 1u);
+}
+
+// intersectSphere for the n <= 8 spheres of the pool starting at first, all at once.
+// Returns the mask of spheres hit before tMax and writes their distances to t.
+uint32_t intersectSpheres8(const SpherePool& pool, uint32_t first, uint32_t n,
+                           const glm::vec3& origin, const glm::vec3& dir, float tMax, float* t) {
+    // Disabled lanes load zeros and are dropped from the returned mask.
+    const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(LANE_MASKS + 8 - n));
+    auto load = [&](const Buffer<float>& values) { return _mm256_maskload_ps(values.data() + first, lanes); };
+    const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+    const __m256 radius = load(pool.radius);
+    const __m256 radiusSquared = _mm256_mul_ps(radius, radius);
+
+    // oc = origin - center, b = oc . dir, chord = oc - b * dir
+    const __m256 ocx = _mm256_sub_ps(_mm256_set1_ps(origin.x), load(pool.cx));
+    const __m256 ocy = _mm256_sub_ps(_mm256_set1_ps(origin.y), load(pool.cy));
+    const __m256 ocz = _mm256_sub_ps(_mm256_set1_ps(origin.z), load(pool.cz));
+    const __m256 b = dot8(ocx, ocy, ocz, dx, dy, dz);
+    const __m256 chordX = negMulAdd8(b, dx, ocx);
+    const __m256 chordY = negMulAdd8(b, dy, ocy);
+    const __m256 chordZ = negMulAdd8(b, dz, ocz);
+    const __m256 discriminant = _mm256_sub_ps(radiusSquared, dot8(chordX, chordY, chordZ, chordX, chordY, chordZ));
+
+    // Most groups a ray reaches miss every sphere; skip the square root and division then.
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 valid = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+    const uint32_t candidates = static_cast<uint32_t>(_mm256_movemask_ps(valid)) & ((1u << n) - 1u);
+    if (!candidates)
+        return 0;
+
+    // q = -(b + copysign(sqrt(discriminant), b)); the roots are q and c / q. Misses take
+    // the root of zero, so sqrt never sees a negative value.
+    const __m256 c = _mm256_sub_ps(dot8(ocx, ocy, ocz, ocx, ocy, ocz), radiusSquared);
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+    const __m256 q = _mm256_xor_ps(_mm256_add_ps(b, _mm256_or_ps(root, _mm256_and_ps(b, signBit))), signBit);
+    // q is 0 only when both roots are, for a ray starting on the sphere and grazing it.
+    // Those lanes divide by 1 instead and are dropped like the scalar test drops them.
+    const __m256 degenerate = _mm256_cmp_ps(q, zero, _CMP_EQ_OQ);
+    const __m256 cq = _mm256_div_ps(c, _mm256_blendv_ps(q, _mm256_set1_ps(1.0f), degenerate));
+    const __m256 t1 = _mm256_min_ps(q, cq);
+    const __m256 t2 = _mm256_max_ps(q, cq);
+    const __m256 tHit = _mm256_blendv_ps(t2, t1, _mm256_cmp_ps(t1, zero, _CMP_GT_OQ));
+
+    const __m256 inRange = _mm256_andnot_ps(degenerate,
+        _mm256_and_ps(_mm256_cmp_ps(tHit, zero, _CMP_GT_OQ), _mm256_cmp_ps(tHit, _mm256_set1_ps(tMax), _CMP_LT_OQ)));
+
+    _mm256_storeu_ps(t, tHit);
+    return static_cast<uint32_t>(_mm256_movemask_ps(inRange)) & candidates;
+}
+#endif
+
+} // namespace
+
+void TrianglePool::add(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, uint32_t material,
+                       uint32_t attributes) {
+    glm::vec3 edge1 = v1 - v0;
+    glm::vec3 edge2 = v2 - v0;
+    v0x.push_back(v0.x);
+    v0y.push_back(v0.y);
+    v0z.push_back(v0.z);
+    e1x.push_back(edge1.x);
+    e1y.push_back(edge1.y);
+    e1z.push_back(edge1.z);
+    e2x.push_back(edge2.x);
+    e2y.push_back(edge2.y);
+    e2z.push_back(edge2.z);
+    materialIndex.push_back(material);
+    attributeIndex.push_back(attributes);
+    lightIndex.push_back(HitRecord::NO_LIGHT);
+}
+
+AABB TrianglePool::bounds(uint32_t i) const {
+    glm::vec3 v0 = vertex0(i);
+    glm::vec3 v1 = v0 + edge1(i);
+    glm::vec3 v2 = v0 + edge2(i);
+    glm::vec3 min = glm::min(glm::min(v0, v1), v2);
+    glm::vec3 max = glm::max(glm::max(v0, v1), v2);
+    // Same padding as Triangle::getBounds so flat triangles still have volume
+    const float eps = 0.0001f;
+    if (min.x == max.x) max.x += eps;
+    if (min.y == max.y) max.y += eps;
+    if (min.z == max.z) max.z += eps;
+    return AABB(min, max);
+}
+
+void TrianglePool::intersect(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir,
+                             PrimitiveHit& hit) const {
+#if defined(__AVX__)
+    for (uint32_t group = first; group < first + count; group += 8) {
+        alignas(32) float t[8];
+        uint32_t mask = intersectTriangles8(*this, group, std::min(8u, first + count - group), origin, dir, hit.t, t);
+        // Lowest index first with a strict comparison, so ties go the same way as the scalar loop.
+        for (; mask; mask &= mask - 1) {
+            int lane = std::countr_zero(mask);
+            if (t[lane] < hit.t) {
+                hit.t = t[lane];
+                hit.index = group + lane;
+                hit.type = PrimitiveType::Triangle;
+            }
+        }
+    }
+#else
+    for (uint32_t i = first; i < first + count; i++) {
+        float t;
+        if (intersectTriangle(origin, dir, vertex0(i), edge1(i), edge2(i), t) && t < hit.t) {
+            hit.t = t;
+            hit.index = i;
+            hit.type = PrimitiveType::Triangle;
+        }
+    }
+#endif
+}
+
+bool TrianglePool::occluded(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir,
+                            float tMax) const {
+#if defined(__AVX__)
+    for (uint32_t group = first; group < first + count; group += 8) {
+        alignas(32) float t[8];
+        if (intersectTriangles8(*this, group, std::min(8u, first + count - group), origin, dir, tMax, t))
+            return true;
+    }
+#else
+    for (uint32_t i = first; i < first + count; i++) {
+        float t;
+        if (intersectTriangle(origin, dir, vertex0(i), edge1(i), edge2(i), t) && t < tMax)
+            return true;
+    }
+#endif
+    return false;
+}
+
+void TrianglePool::permute(const std::vector<uint32_t>& order, uint32_t first) {
+    for (auto* values : { &v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z })
+        permuteArray(*values, order, first);
+    permuteArray(materialIndex, order, first);
+    permuteArray(attributeIndex, order, first);
+    permuteArray(lightIndex, order, first);
+}
+
+void SpherePool::add(const glm::vec3& center, float r, uint32_t material) {
+    cx.push_back(center.x);
+    cy.push_back(center.y);
+    cz.push_back(center.z);
+    radius.push_back(r);
+    materialIndex.push_back(material);
+    lightIndex.push_back(HitRecord::NO_LIGHT);
+}
+
+AABB SpherePool::bounds(uint32_t i) const {
+    glm::vec3 c = center(i);
+    return AABB(c - glm::vec3(radius[i]), c + glm::vec3(radius[i]));
+}
+
+void SpherePool::intersect(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir,
+                           PrimitiveHit& hit) const {
+#if defined(__AVX__)
+    for (uint32_t group = first; group < first + count; group += 8) {
+        alignas(32) float t[8];
+        uint32_t mask = intersectSpheres8(*this, group, std::min(8u, first + count - group), origin, dir, hit.t, t);
+        for (; mask; mask &= mask - 1) {
+            int lane = std::countr_zero(mask);
+            if (t[lane] < hit.t) {
+                hit.t = t[lane];
+                hit.index = group + lane;
+                hit.type = PrimitiveType::Sphere;
+            }
+        }
+    }
+#else
+    for (uint32_t i = first; i < first + count; i++) {
+        float t;
+        if (intersectSphere(origin, dir, center(i), radius[i], t) && t < hit.t) {
+            hit.t = t;
+            hit.index = i;
+            hit.type = PrimitiveType::Sphere;
+        }
+    }
+#endif
+}
+
+bool SpherePool::occluded(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir,
+                          float tMax) const {
+#if defined(__AVX__)
+    for (uint32_t group = first; group < first + count; group += 8) {
+        alignas(32) float t[8];
+        if (intersectSpheres8(*this, group, std::min(8u, first + count - group), origin, dir, tMax, t))
+            return true;
+    }
+#else
+    for (uint32_t i = first; i < first + count; i++) {
+        float t;
+        if (intersectSphere(origin, dir, center(i), radius[i], t) && t < tMax)
+            return true;
+    }
+#endif
+    return false;
+}
+
+void SpherePool::permute(const std::vector<uint32_t>& order, uint32_t first) {
+    for (auto* values : { &cx, &cy, &cz, &radius })
+        permuteArray(*values, order, first);
+    permuteArray(materialIndex, order, first);
+    permuteArray(lightIndex, order, first);
+}
+
+void PrimitivePools::clear() {
+    triangles = TrianglePool();
+    spheres = SpherePool();
+    attributes = VertexAttributes();
+}
+
+void PrimitivePools::setLightIndex(size_t firstTriangle, size_t firstSphere, uint32_t light, bool perPrimitive) {
+    std::vector<uint32_t>& triangleLights = triangles.lightIndex.values();
+    std::vector<uint32_t>& sphereLights = spheres.lightIndex.values();
+    if (!perPrimitive) {
+        std::fill(triangleLights.begin() + firstTriangle, triangleLights.end(), light);
+        std::fill(sphereLights.begin() + firstSphere, sphereLights.end(), light);
+        return;
+    }
+    std::iota(triangleLights.begin() + firstTriangle, triangleLights.end(), light);
+    std::iota(sphereLights.begin() + firstSphere, sphereLights.end(),
+              light + static_cast<uint32_t>(triangleLights.size() - firstTriangle));
+}
+
+void PrimitivePools::collectBounds(std::vector<AABB>& bounds, std::vector<uint8_t>& types) const {
+    size_t triangleCount = triangles.size();
+    bounds.resize(triangleCount + spheres.size());
+    types.resize(bounds.size());
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < triangleCount; i++) {
+        bounds[i] = triangles.bounds(static_cast<uint32_t>(i));
+        types[i] = static_cast<uint8_t>(PrimitiveType::Triangle);
+    }
+    for (size_t i = 0; i < spheres.size(); i++) {
+        bounds[triangleCount + i] = spheres.bounds(static_cast<uint32_t>(i));
+        types[triangleCount + i] = static_cast<uint8_t>(PrimitiveType::Sphere);
+    }
+}
+
+void PrimitivePools::reorder(const std::vector<uint32_t>& order) {
+    uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+    std::vector<uint32_t> triangleOrder, sphereOrder;
+    triangleOrder.reserve(triangles.size());
+    sphereOrder.reserve(spheres.size());
+    for (uint32_t index : order) {
+        if (index < triangleCount)
+            triangleOrder.push_back(index);
+        else
+            sphereOrder.push_back(index - triangleCount);
+    }
+    triangles.permute(triangleOrder);
+    spheres.permute(sphereOrder);
+}
+
+void PrimitivePools::copyTriangle(uint32_t slot, const PrimitivePools& source, uint32_t i) {
+    const TrianglePool& from = source.triangles;
+    auto copy = [&](Buffer<float>& to, const Buffer<float>& values) { to.at(slot) = values[i]; };
+    copy(triangles.v0x, from.v0x);
+    copy(triangles.v0y, from.v0y);
+    copy(triangles.v0z, from.v0z);
+    copy(triangles.e1x, from.e1x);
+    copy(triangles.e1y, from.e1y);
+    copy(triangles.e1z, from.e1z);
+    copy(triangles.e2x, from.e2x);
+    copy(triangles.e2y, from.e2y);
+    copy(triangles.e2z, from.e2z);
+
+    uint32_t corners = triangles.attributeIndex[slot];
+    uint32_t sourceCorners = from.attributeIndex[i];
+    if (corners == TrianglePool::NO_ATTRIBUTES || sourceCorners == TrianglePool::NO_ATTRIBUTES)
+        return;
+    for (uint32_t c = 0; c < 3; c++) {
+        uint32_t vertex = attributes.corners[corners + c];
+        uint32_t sourceVertex = source.attributes.corners[sourceCorners + c];
+        attributes.normals.at(vertex) = source.attributes.normals[sourceVertex];
+        attributes.uvs.at(vertex) = source.attributes.uvs[sourceVertex];
+    }
+}
+
+void PrimitivePools::copySphere(uint32_t slot, const PrimitivePools& source, uint32_t i) {
+    const SpherePool& from = source.spheres;
+    spheres.cx.at(slot) = from.cx[i];
+    spheres.cy.at(slot) = from.cy[i];
+    spheres.cz.at(slot) = from.cz[i];
+    spheres.radius.at(slot) = from.radius[i];
+}
+
+void PrimitivePools::fillHitRecord(const PrimitiveHit& hit, const glm::vec3& origin, const glm::vec3& dir,
+                                   HitRecord& rec) const {
+    rec.t = hit.t;
+    rec.hitPoint = origin + dir * hit.t;
+    rec.primitiveIndex = hit.index;
+
+    if (hit.type == PrimitiveType::Triangle) {
+        glm::vec3 normal = glm::normalize(glm::cross(triangles.edge1(hit.index), triangles.edge2(hit.index)));
+        // Ensure normal faces toward the ray origin
+        if (glm::dot(normal, dir) > 0.0f)
+            normal = -normal;
+        rec.materialId = triangles.materialIndex[hit.index];
+        rec.lightIndex = triangles.lightIndex[hit.index];
+
+        uint32_t first = triangles.attributeIndex[hit.index];
+        if (first != TrianglePool::NO_ATTRIBUTES) {
+            // Barycentrics are recomputed here for the one final hit rather than kept
+            // for every candidate during traversal.
+            glm::vec2 b = triangleBarycentrics(rec.hitPoint, triangles.vertex0(hit.index),
+                                               triangles.edge1(hit.index), triangles.edge2(hit.index));
+            float b0 = 1.0f - b.x - b.y;
+            uint32_t i0 = attributes.corners[first];
+            uint32_t i1 = attributes.corners[first + 1];
+            uint32_t i2 = attributes.corners[first + 2];
+
+            rec.uv = attributes.uvs[i0] * b0 + attributes.uvs[i1] * b.x + attributes.uvs[i2] * b.y;
+
+            glm::vec3 shading = attributes.normals[i0] * b0 + attributes.normals[i1] * b.x + attributes.normals[i2] * b.y;
+            if (glm::dot(shading, shading) > 0.0f) {
+                shading = glm::normalize(shading);
+                normal = glm::dot(shading, dir) > 0.0f ? -shading : shading;
+            }
+        }
+        rec.normal = normal;
+    } else {
+        rec.normal = (rec.hitPoint - spheres.center(hit.index)) / spheres.radius[hit.index];
+        rec.materialId = spheres.materialIndex[hit.index];
+        rec.lightIndex = spheres.lightIndex[hit.index];
+    }
+}
@@ -0,0 +1,216 @@
+//
+// Created by alex on 3/16/25.
+//
+
+// Primitives.h
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include "AABB.h"
+#include "Buffer.h"
+#include "Entity.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+enum class PrimitiveType : uint8_t {
+    Triangle = 0,
+    Sphere = 1
+};
+
+// Smallest determinant and distance the triangle tests accept.
+constexpr float TRIANGLE_EPSILON = 1e-8f;
+
+// Möller–Trumbore ray/triangle test. On a hit in front of the origin, t holds the distance.
+inline bool intersectTriangle(const glm::vec3& origin, const glm::vec3& dir,
+                              const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2, float& t) {
+    glm::vec3 h = glm::cross(dir, edge2);
+    float a = glm::dot(edge1, h);
+    if (std::abs(a) < TRIANGLE_EPSILON)
+        return false;  // Ray is parallel to triangle.
+
+    float f = 1.0f / a;
+    glm::vec3 s = origin - v0;
+    float u = f * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = f * glm::dot(dir, q);
+    if (v < 0.0f || (u + v) > 1.0f)
+        return false;
+
+    t = f * glm::dot(edge2, q);
+    return t > TRIANGLE_EPSILON;
+}
+
+// Barycentric weights of v1 and v2 for a point in the plane of the triangle.
+inline glm::vec2 triangleBarycentrics(const glm::vec3& p, const glm::vec3& v0,
+                                      const glm::vec3& edge1, const glm::vec3& edge2) {
+    glm::vec3 d = p - v0;
+    float d00 = glm::dot(edge1, edge1);
+    float d01 = glm::dot(edge1, edge2);
+    float d11 = glm::dot(edge2, edge2);
+    float d20 = glm::dot(d, edge1);
+    float d21 = glm::dot(d, edge2);
+    float invDenom = 1.0f / (d00 * d11 - d01 * d01);
+    return glm::vec2((d11 * d20 - d01 * d21) * invDenom, (d00 * d21 - d01 * d20) * invDenom);
+}
+
+// Ray/sphere test returning the nearest positive root. dir must be unit length, as all
+// traced rays are, so the quadratic is t^2 + 2bt + c. The discriminant is taken as
+// r^2 - |oc - b dir|^2, which unlike b^2 - c does not cancel for a small sphere far
+// from the origin, and the second root comes from c / q instead of a subtraction.
+inline bool intersectSphere(const glm::vec3& origin, const glm::vec3& dir,
+                            const glm::vec3& center, float radius, float& t) {
+    glm::vec3 oc = origin - center;
+    float b = glm::dot(oc, dir);
+    glm::vec3 chord = oc - b * dir;
+    float radiusSquared = radius * radius;
+    float discriminant = radiusSquared - glm::dot(chord, chord);
+    if (discriminant < 0.0f)
+        return false;
+
+    float c = glm::dot(oc, oc) - radiusSquared;
+    float q = -b - std::copysign(std::sqrt(discriminant), b);
+    if (q == 0.0f)
+        return false;  // Both roots are 0: the ray starts on the sphere and grazes it.
+    float t1 = std::min(q, c / q);
+    float t2 = std::max(q, c / q);
+    t = (t1 > 0.0f) ? t1 : t2;
+    return t > 0.0f;
+}
+
+// Closest primitive found so far during traversal. Shading data is only fetched
+// for the final hit, see PrimitivePools::fillHitRecord.
+struct PrimitiveHit {
+    float t = std::numeric_limits<float>::infinity();
+    uint32_t index = 0;
+    PrimitiveType type = PrimitiveType::Triangle;
+};
+
+// Triangles stored as SoA arrays of the first vertex and the two edges from it. After
+// PrimitivePools::reorder a BVH leaf is a contiguous range of at most BVH::MAX_LEAF_SIZE
+// triangles, which intersect and occluded test eight at a time with AVX.
+struct TrianglePool {
+    static constexpr uint32_t NO_ATTRIBUTES = 0xFFFFFFFFu;
+
+    Buffer<float> v0x, v0y, v0z;
+    Buffer<float> e1x, e1y, e1z;
+    Buffer<float> e2x, e2y, e2z;
+    Buffer<uint32_t> materialIndex;
+    Buffer<uint32_t> attributeIndex;   // First of three VertexAttributes::corners entries, or NO_ATTRIBUTES.
+    Buffer<uint32_t> lightIndex;       // LightSampler emitter index, or HitRecord::NO_LIGHT.
+
+    size_t size() const { return v0x.size(); }
+
+    void add(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, uint32_t material,
+             uint32_t attributes = NO_ATTRIBUTES);
+
+    glm::vec3 vertex0(uint32_t i) const { return glm::vec3(v0x[i], v0y[i], v0z[i]); }
+    glm::vec3 edge1(uint32_t i) const { return glm::vec3(e1x[i], e1y[i], e1z[i]); }
+    glm::vec3 edge2(uint32_t i) const { return glm::vec3(e2x[i], e2y[i], e2z[i]); }
+
+    AABB bounds(uint32_t i) const;
+
+    void intersect(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir, PrimitiveHit& hit) const;
+    bool occluded(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+
+    // Moves triangle first + order[i] to first + i.
+    void permute(const std::vector<uint32_t>& order, uint32_t first = 0);
+};
+
+// Spheres stored as SoA arrays of centers and radii, tested eight at a time with AVX
+// like the triangles. Normals are only computed for the final hit.
+struct SpherePool {
+    Buffer<float> cx, cy, cz;
+    Buffer<float> radius;
+    Buffer<uint32_t> materialIndex;
+    Buffer<uint32_t> lightIndex;
+
+    size_t size() const { return cx.size(); }
+
+    void add(const glm::vec3& center, float r, uint32_t material);
+
+    glm::vec3 center(uint32_t i) const { return glm::vec3(cx[i], cy[i], cz[i]); }
+
+    AABB bounds(uint32_t i) const;
+
+    void intersect(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir, PrimitiveHit& hit) const;
+    bool occluded(uint32_t first, uint32_t count, const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+
+    // Moves sphere first + order[i] to first + i.
+    void permute(const std::vector<uint32_t>& order, uint32_t first = 0);
+};
+
+// Per-vertex shading data of meshes that have normals or uvs. Only read for the final
+// hit of a ray, so it is kept out of the traversal pools.
+struct VertexAttributes {
+    Buffer<glm::vec3> normals;    // Zero where the mesh has no normals.
+    Buffer<glm::vec2> uvs;
+    Buffer<uint32_t> corners;     // Three vertex indices per attributed triangle.
+};
+
+// Per-type geometry pools the BVH is built over. Each primitive keeps the
+// MaterialTable index of its entity. Entities add themselves here through Entity::addToPools.
+struct PrimitivePools {
+    TrianglePool triangles;
+    SpherePool spheres;
+    VertexAttributes attributes;
+
+    void clear();
+
+    // Marks the primitives from firstTriangle and firstSphere to the end of their pools
+    // as the emitter light, so hits on them can be traced back to the LightSampler. With
+    // perPrimitive each is its own emitter, numbered from light, triangles first.
+    void setLightIndex(size_t firstTriangle, size_t firstSphere, uint32_t light, bool perPrimitive = false);
+
+    // Bounds and type of every primitive, triangles first and spheres after them.
+    void collectBounds(std::vector<AABB>& bounds, std::vector<uint8_t>& types) const;
+
+    // Reorders the pools so primitives appear in the given order, using the
+    // numbering of collectBounds. Makes every BVH leaf a contiguous pool range.
+    void reorder(const std::vector<uint32_t>& order);
+
+    // Reorders one pool range, see TrianglePool::permute.
+    void permute(PrimitiveType type, uint32_t first, const std::vector<uint32_t>& order) {
+        if (type == PrimitiveType::Triangle)
+            triangles.permute(order, first);
+        else
+            spheres.permute(order, first);
+    }
+
+    // Overwrite the geometry at pool slot with primitive i of source, which holds the same
+    // entity added again after an edit. Triangles also take the normals and uvs of their
+    // corners. Materials and light tags stay as they are.
+    void copyTriangle(uint32_t slot, const PrimitivePools& source, uint32_t i);
+    void copySphere(uint32_t slot, const PrimitivePools& source, uint32_t i);
+
+    AABB bounds(PrimitiveType type, uint32_t i) const {
+        return type == PrimitiveType::Triangle ? triangles.bounds(i) : spheres.bounds(i);
+    }
+
+    void intersect(PrimitiveType type, uint32_t first, uint32_t count,
+                   const glm::vec3& origin, const glm::vec3& dir, PrimitiveHit& hit) const {
+        if (type == PrimitiveType::Triangle)
+            triangles.intersect(first, count, origin, dir, hit);
+        else
+            spheres.intersect(first, count, origin, dir, hit);
+    }
+
+    bool occluded(PrimitiveType type, uint32_t first, uint32_t count,
+                  const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+        if (type == PrimitiveType::Triangle)
+            return triangles.occluded(first, count, origin, dir, tMax);
+        return spheres.occluded(first, count, origin, dir, tMax);
+    }
+
+    // Computes the hit point, normal, uv and material id of the final hit. Mesh triangles
+    // with normals get the interpolated shading normal.
+    void fillHitRecord(const PrimitiveHit& hit, const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const;
+};
+
+#endif // PRIMITIVES_H
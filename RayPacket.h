@@ -0,0 +1,146 @@
+//
+// Created by alex on 3/28/25.
+//
+
+// RayPacket.h
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include "AABB.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// Up to SIZE rays from one origin, such as the camera rays of neighbouring pixels, stored
+// SoA so a BVH node is slab-tested against all of them at once. Lanes past count repeat
+// the first ray and are never reported.
+struct alignas(32) RayPacket {
+    static constexpr int SIZE = 8;
+
+    glm::vec3 origin = glm::vec3(0.0f);
+    alignas(32) float dirX[SIZE], dirY[SIZE], dirZ[SIZE];
+    alignas(32) float invX[SIZE], invY[SIZE], invZ[SIZE];
+    int count = 0;
+
+    // Filled in by prepare(). The interval of inverse directions bounds every ray in the
+    // packet at once, which only works when all rays head the same way on every axis.
+    bool coherent = false;
+    bool negative[3] = {};
+    glm::vec3 invMin = glm::vec3(0.0f), invMax = glm::vec3(0.0f);
+
+    void add(const glm::vec3& dir) {
+        dirX[count] = dir.x;
+        dirY[count] = dir.y;
+        dirZ[count] = dir.z;
+        count++;
+    }
+
+    glm::vec3 direction(int lane) const { return glm::vec3(dirX[lane], dirY[lane], dirZ[lane]); }
+
+    uint32_t activeMask() const { return (1u << count) - 1u; }
+
+    // Pads unused lanes and computes the inverse directions and their bounds.
+    void prepare() {
+        for (int i = count; i < SIZE; i++) {
+            dirX[i] = dirX[0];
+            dirY[i] = dirY[0];
+            dirZ[i] = dirZ[0];
+        }
+        coherent = count > 0;
+        for (int axis = 0; axis < 3; axis++) {
+            const float* dir = axis == 0 ? dirX : axis == 1 ? dirY : dirZ;
+            float* inv = axis == 0 ? invX : axis == 1 ? invY : invZ;
+            negative[axis] = dir[0] < 0.0f;
+            float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+            for (int i = 0; i < SIZE; i++) {
+                inv[i] = 1.0f / dir[i];
+                lo = std::min(lo, inv[i]);
+                hi = std::max(hi, inv[i]);
+                if (dir[i] == 0.0f || (dir[i] < 0.0f) != negative[axis])
+                    coherent = false;
+            }
+            invMin[axis] = lo;
+            invMax[axis] = hi;
+        }
+    }
+
+    // Interval arithmetic cull: false only if no ray of a coherent packet can hit bounds
+    // before tMax. Costs the same as one single-ray slab test, whatever the packet size.
+    bool mayHit(const AABB& bounds, float tMax) const {
+        float tEnter = 0.0f;
+        float tExit = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            float nearPlane = negative[axis] ? bounds.max[axis] : bounds.min[axis];
+            float farPlane = negative[axis] ? bounds.min[axis] : bounds.max[axis];
+            float dNear = nearPlane - origin[axis];
+            float dFar = farPlane - origin[axis];
+            // Smallest entry and largest exit distance over all inverse directions in the interval.
+            tEnter = std::max(tEnter, dNear * (dNear >= 0.0f ? invMin[axis] : invMax[axis]));
+            tExit = std::min(tExit, dFar * (dFar >= 0.0f ? invMax[axis] : invMin[axis]));
+        }
+        return tEnter <= tExit;
+    }
+};
+
+// Up to SIZE rays that each have their own origin and length but head into the same
+// octant, such as neighbouring secondary or shadow rays after sorting by direction and
+// origin. Every lane shares one near-to-far child order, so the batch walks the BVH
+// together and each node is slab-tested against all of its rays at once. Lanes past
+// count repeat the first ray and are never reported.
+struct alignas(32) RayBatch {
+    static constexpr int SIZE = RayPacket::SIZE;
+
+    alignas(32) float originX[SIZE], originY[SIZE], originZ[SIZE];
+    alignas(32) float dirX[SIZE], dirY[SIZE], dirZ[SIZE];
+    alignas(32) float invX[SIZE], invY[SIZE], invZ[SIZE];
+    alignas(32) float scaledX[SIZE], scaledY[SIZE], scaledZ[SIZE];   // origin * inverse direction.
+    alignas(32) float tMax[SIZE];
+    int count = 0;
+    bool negative[3] = {};   // Direction signs of the first ray, filled in by prepare().
+
+    // Rays that do not share the octant of the first are still traced correctly, only
+    // with a child order that does not suit them.
+    void add(const glm::vec3& origin, const glm::vec3& dir,
+             float length = std::numeric_limits<float>::infinity()) {
+        originX[count] = origin.x;
+        originY[count] = origin.y;
+        originZ[count] = origin.z;
+        dirX[count] = dir.x;
+        dirY[count] = dir.y;
+        dirZ[count] = dir.z;
+        tMax[count] = length;
+        count++;
+    }
+
+    glm::vec3 origin(int lane) const { return glm::vec3(originX[lane], originY[lane], originZ[lane]); }
+    glm::vec3 direction(int lane) const { return glm::vec3(dirX[lane], dirY[lane], dirZ[lane]); }
+
+    uint32_t activeMask() const { return (1u << count) - 1u; }
+
+    // Pads unused lanes and computes the inverse directions.
+    void prepare() {
+        for (int i = count; i < SIZE; i++) {
+            originX[i] = originX[0];
+            originY[i] = originY[0];
+            originZ[i] = originZ[0];
+            dirX[i] = dirX[0];
+            dirY[i] = dirY[0];
+            dirZ[i] = dirZ[0];
+            tMax[i] = tMax[0];
+        }
+        for (int i = 0; i < SIZE; i++) {
+            invX[i] = 1.0f / dirX[i];
+            invY[i] = 1.0f / dirY[i];
+            invZ[i] = 1.0f / dirZ[i];
+            scaledX[i] = originX[i] * invX[i];
+            scaledY[i] = originY[i] * invY[i];
+            scaledZ[i] = originZ[i] * invZ[i];
+        }
+        negative[0] = dirX[0] < 0.0f;
+        negative[1] = dirY[0] < 0.0f;
+        negative[2] = dirZ[0] < 0.0f;
+    }
+};
+
+#endif // RAYPACKET_H
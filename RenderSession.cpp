@@ -0,0 +1,43 @@
+//
+// Created by alex on 3/19/25.
+//
+
+// RenderSession.cpp
+#include "RenderSession.h"
+#include <algorithm>
+
+RenderSession::RenderSession(const RenderSettings& settings)
+    : settings(settings),
+      scheduler(settings.width, settings.height, settings.tileSize),
+      accumulation(static_cast<size_t>(settings.width) * settings.height),
+      sampleCounts(static_cast<size_t>(settings.width) * settings.height, 0) {}
+
+void RenderSession::setCamera(const Camera& newCamera) {
+    if (hasCamera && newCamera == camera)
+        return;
+    camera = newCamera;
+    hasCamera = true;
+    reset();
+}
+
+void RenderSession::reset() {
+    std::fill(accumulation.begin(), accumulation.end(), Spectrum(0.0f));
+    std::fill(sampleCounts.begin(), sampleCounts.end(), 0u);
+    sampleCount = 0;
+}
+
+void RenderSession::renderFrame(const Scene& scene, int samplesPerFrame) {
+    scheduler.setSampleBudget(samplesPerFrame);
+    Renderer::accumulateSamples(accumulation.data(), sampleCounts.data(), scene, camera, settings, scheduler);
+    sampleCount += samplesPerFrame;
+}
+
+void RenderSession::resolve(uint32_t* pixels) const {
+    #pragma omp parallel for
+    for (size_t i = 0; i < accumulation.size(); i++) {
+        if (sampleCounts[i] == 0)
+            pixels[i] = 0xFF000000u;
+        else
+            pixels[i] = Renderer::toARGB(accumulation[i] * (1.0f / sampleCounts[i]));
+    }
+}
@@ -0,0 +1,58 @@
+//
+// Created by alex on 3/19/25.
+//
+
+// RenderSession.h
+#ifndef RENDERSESSION_H
+#define RENDERSESSION_H
+
+#include "Renderer.h"
+#include "RenderSettings.h"
+#include "Scene.h"
+#include "SpectralData.h"
+#include "TileScheduler.h"
+#include <cstdint>
+#include <vector>
+
+// Progressive rendering state for an interactive view. Samples from every frame are
+// summed into an HDR spectral buffer and the running mean is displayed, so a still view
+// keeps converging. The buffer is cleared only when the camera or the scene changes.
+class RenderSession {
+public:
+    // Image size, tile size and integrator parameters are taken from settings.
+    explicit RenderSession(const RenderSettings& settings);
+
+    // Restarts accumulation if the camera differs from the one used so far.
+    void setCamera(const Camera& camera);
+
+    // Discards all accumulated samples. Call after editing the scene.
+    void reset();
+
+    // Adds samplesPerFrame more samples to every pixel.
+    void renderFrame(const Scene& scene, int samplesPerFrame);
+
+    // Writes the per-pixel mean of the accumulated samples as packed ARGB.
+    void resolve(uint32_t* pixels) const;
+
+    const RenderSettings& getSettings() const { return settings; }
+
+    int getWidth() const { return scheduler.getWidth(); }
+    int getHeight() const { return scheduler.getHeight(); }
+
+    // Samples per pixel added by renderFrame since the last reset.
+    int getSampleCount() const { return sampleCount; }
+
+    // Tiles of the image; their sample budgets can be adjusted between frames.
+    TileScheduler& getScheduler() { return scheduler; }
+
+private:
+    RenderSettings settings;
+    TileScheduler scheduler;
+    Camera camera;
+    bool hasCamera = false;
+    int sampleCount = 0;
+    std::vector<Spectrum> accumulation;
+    std::vector<uint32_t> sampleCounts;
+};
+
+#endif // RENDERSESSION_H
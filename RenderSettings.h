@@ -0,0 +1,31 @@
+//
+// Created by alex on 3/22/25.
+//
+
+// RenderSettings.h
+#ifndef RENDERSETTINGS_H
+#define RENDERSETTINGS_H
+
+#include <cmath>
+
+// Image and integrator parameters chosen at run time, so previews and final renders
+// come from the same binary. The defaults match the interactive view.
+struct RenderSettings {
+    int width = 800;
+    int height = 600;
+    int samplesPerPixel = 32;       // Increase for less noise.
+    int samplesPerFrame = 1;        // Samples added per interactive frame.
+    int maxDepth = 16;              // Hard limit on path length.
+    int minDepth = 3;               // Bounces before Russian roulette may end a path.
+    int tileSize = 16;              // Tile edge in pixels; one tile is one unit of scheduling.
+    float fov = M_PI / 3.0f;        // Vertical field of view in radians, 60° by default.
+    float shadowBias = 1e-4f;       // To avoid self-intersection.
+    bool heroWavelengths = false;   // Trace HERO_WAVELENGTHS bins per path instead of the full spectrum.
+    bool lightBVH = false;          // Pick shadow ray lights by power and distance instead of power alone.
+    bool wavefront = false;         // Trace bounces in sorted ray queues, see WavefrontIntegrator. Not a CLI option.
+
+    // Half-height of the image plane at unit distance from the camera.
+    float imagePlaneScale() const { return std::tan(fov / 2.0f); }
+};
+
+#endif // RENDERSETTINGS_H
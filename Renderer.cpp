@@ -3,156 +3,184 @@
 //
 
 // Renderer.cpp
-#include "Constants.h"
-#include "SpectralData.h"
 #include "Renderer.h"
-#include "Scene.h"
-#include "SamplingHelpers.h"
+#include "PathIntegrator.h"
+#include "WavefrontIntegrator.h"
 #include <cmath>
 #include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/glm.hpp>
 #include <limits>
-
-Spectrum traceRaySpectral(const glm::vec3& rayOrigin,
-                           const glm::vec3& rayDir,
-                           int depth,
-                           const Scene& scene) {
-    HitRecord closestHit;
-    closestHit.t = std::numeric_limits<float>::infinity();
-    bool hitSomething = false;
-
-    if (scene.bvh) {
-        hitSomething = scene.bvh->intersect(rayOrigin, rayDir, closestHit);
-    } else {
-        // Fallback to the existing loop if BVH not built
-        for (const auto& entity : scene.entities) {
-            HitRecord rec;
-            if (entity->intersect(rayOrigin, rayDir, rec)) {
-                if (rec.t < closestHit.t) {
-                    closestHit = rec;
-                    closestHit.hitEntity = entity;
-                    hitSomething = true;
-                }
-            }
-        }
+#include <optional>
+#include <vector>
+
+namespace {
+
+// Iterative path tracer that follows one path from camera to end: each vertex is shaded
+// by shadeVertex and its shadow ray traced right away.
+// The camera ray has already been traced in a packet: primaryHit is its closest hit
+// if primaryFound is set.
+// A nonzero FixedMaxDepth replaces settings.maxDepth with a compile-time bound.
+// Path decides which wavelengths are carried, see FullSpectrumPath and HeroWavelengthPath.
+template <int FixedMaxDepth, typename Path>
+typename Path::PathSpectrum traceRaySpectral(PathState<Path>& state,
+                                             bool primaryFound,
+                                             const HitRecord& primaryHit,
+                                             const Scene& scene,
+                                             const RenderSettings& settings,
+                                             Sampler& sampler) {
+    const int maxDepth = FixedMaxDepth > 0 ? FixedMaxDepth : settings.maxDepth;
+
+    HitRecord closestHit = primaryHit;
+    bool hitSomething = primaryFound;
+    ShadowRay<typename Path::PathSpectrum> shadow;
+    while (true) {
+        bool continues = shadeVertex(state, hitSomething, closestHit, scene, settings, maxDepth, sampler, shadow);
+        if (shadow.pending && !scene.occluded(shadow.origin, shadow.dir, shadow.tMax))
+            state.radiance += shadow.contribution;
+        if (!continues)
+            break;
+
+        closestHit.t = std::numeric_limits<float>::infinity();
+        hitSomething = scene.intersect(state.origin, state.dir, closestHit);
     }
 
-    if (!hitSomething)
-        return backgroundSpectrum;
-
-    // Direct hit on an emissive surface.
-    if (closestHit.isEmissive)
-        return closestHit.emission;
-
-    // Start with ambient light.
-    Spectrum localColor = closestHit.color * Spectrum(0.1f);  // Ambient term
-
-    // Process emissive entities (lights) as before...
-    for (const auto& entity : scene.entities) {
-        if (!entity->isEmissive())
-            continue;
-
-        glm::vec3 samplePoint, lightNormal;
-        float pdf;
-        entity->sampleLight(closestHit.hitPoint, samplePoint, lightNormal, pdf);
-
-        glm::vec3 lightDir = samplePoint - closestHit.hitPoint;
-        float distance = glm::length(lightDir);
-        lightDir = glm::normalize(lightDir);
+    return state.radiance;
+}
 
-        glm::vec3 shadowOrigin = closestHit.hitPoint + closestHit.normal * shadowBias;
+template <int FixedMaxDepth, typename Path>
+void accumulateTiles(Spectrum* accumulation,
+                     uint32_t* sampleCounts,
+                     const Scene& scene,
+                     const Camera& camera,
+                     const RenderSettings& settings,
+                     TileScheduler& scheduler) {
+    const int width = scheduler.getWidth();
+    const int height = scheduler.getHeight();
+    const float scale = settings.imagePlaneScale();
+
+    // Camera rays of a PACKET_WIDTH x PACKET_HEIGHT pixel block are traced together, one
+    // sample index at a time, so their primary hits share BVH node fetches. The rest of
+    // each path is traced on its own.
+    constexpr int PACKET_WIDTH = 4;
+    constexpr int PACKET_HEIGHT = RayPacket::SIZE / PACKET_WIDTH;
+
+    scheduler.run([&](const Tile& tile) {
+        for (int blockY = tile.y0; blockY < tile.y1; blockY += PACKET_HEIGHT) {
+            for (int blockX = tile.x0; blockX < tile.x1; blockX += PACKET_WIDTH) {
+                int pixels[RayPacket::SIZE];
+                int pixelCount = 0;
+                for (int y = blockY; y < std::min(blockY + PACKET_HEIGHT, tile.y1); y++) {
+                    for (int x = blockX; x < std::min(blockX + PACKET_WIDTH, tile.x1); x++)
+                        pixels[pixelCount++] = y * width + x;
+                }
+                Spectrum pixelSpectrum[RayPacket::SIZE];
+                for (int i = 0; i < pixelCount; i++)
+                    pixelSpectrum[i] = Spectrum(0.0f);
+
+                for (int k = 0; k < tile.sampleBudget; k++) {
+                    RayPacket packet;
+                    packet.origin = camera.position;
+                    std::optional<Sampler> samplers[RayPacket::SIZE];
+                    std::optional<PathState<Path>> paths[RayPacket::SIZE];
+
+                    for (int i = 0; i < pixelCount; i++) {
+                        // Each sample owns its random sequence, keyed by pixel and sample index.
+                        Sampler& sampler = samplers[i].emplace(pixels[i], sampleCounts[pixels[i]] + k);
+                        packet.add(cameraRayDirection(camera, pixels[i] % width, pixels[i] / width,
+                                                      width, height, scale, sampler));
+
+                        PathState<Path>& state = paths[i].emplace();
+                        state.path = Path::sample(sampler);
+                        state.origin = camera.position;
+                        state.dir = packet.direction(i);
+                        state.bsdfOrigin = camera.position;
+                    }
+                    packet.prepare();
+
+                    HitRecord primaryHits[RayPacket::SIZE];
+                    const uint32_t found = scene.intersect(packet, primaryHits);
+
+                    for (int i = 0; i < pixelCount; i++) {
+                        paths[i]->path.splat(pixelSpectrum[i],
+                                             traceRaySpectral<FixedMaxDepth>(*paths[i], (found >> i) & 1u, primaryHits[i],
+                                                                             scene, settings, *samplers[i]));
+                    }
+                }
 
-        bool inShadow = false;
-        if (scene.bvh) {
-            HitRecord shadowRec;
-            if (scene.bvh->intersect(shadowOrigin, lightDir, shadowRec) && shadowRec.t < distance) {
-                inShadow = true;
+                for (int i = 0; i < pixelCount; i++) {
+                    accumulation[pixels[i]] += pixelSpectrum[i];
+                    sampleCounts[pixels[i]] += tile.sampleBudget;
+                }
             }
         }
+    });
+}
 
-        if (!inShadow) {
-            float cosTheta = std::max(0.0f, glm::dot(closestHit.normal, lightDir));
-            float distanceSquared = distance * distance;
-            Spectrum lightEmission = entity->getEmission();
-            localColor += closestHit.color * lightEmission * cosTheta / (pdf * distanceSquared);
-        }
+// Common path lengths get their own instantiation so the bounce loop has a constant
+// trip bound; anything else goes through the generic runtime version.
+template <typename Path>
+void accumulateTilesForDepth(Spectrum* accumulation,
+                             uint32_t* sampleCounts,
+                             const Scene& scene,
+                             const Camera& camera,
+                             const RenderSettings& settings,
+                             TileScheduler& scheduler) {
+    switch (settings.maxDepth) {
+        case 4:
+            accumulateTiles<4, Path>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+            break;
+        case 8:
+            accumulateTiles<8, Path>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+            break;
+        case 16:
+            accumulateTiles<16, Path>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+            break;
+        default:
+            accumulateTiles<0, Path>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+            break;
     }
+}
 
-    // Use BSDF for the indirect bounce.
-    if (depth < maxDepth) {
-        BSDF* bsdf = nullptr;
-        if (closestHit.hitEntity) {
-            bsdf = closestHit.hitEntity->getBSDF();
-        }
-
-        if (bsdf) {
-            float bsdfPdf;
-            glm::vec3 newDir = bsdf->sample(-rayDir, closestHit.normal, bsdfPdf);
-            glm::vec3 newOrigin = closestHit.hitPoint + closestHit.normal * shadowBias;
-
-            if (bsdfPdf > 0.0f) {
-                Spectrum indirect = traceRaySpectral(newOrigin, newDir, depth + 1, scene);
-                Spectrum bsdfVal = bsdf->evaluate(-rayDir, newDir, closestHit.normal);
-
-                // Apply proper weighting with the PDF
-                float cosTheta = std::max(0.0f, glm::dot(closestHit.normal, newDir));
-                localColor += indirect * bsdfVal * cosTheta / bsdfPdf;
-            }
-        } else {
-            // Fallback: cosine-weighted hemisphere sampling.
-            glm::vec3 randomDir = random_in_hemisphere(closestHit.normal);
-            glm::vec3 newOrigin = closestHit.hitPoint + closestHit.normal * shadowBias;
-            Spectrum indirect = traceRaySpectral(newOrigin, randomDir, depth + 1, scene);
-            localColor += indirect * closestHit.color * 0.5f;
-        }
+} // namespace
+
+void Renderer::accumulateSamples(Spectrum* accumulation,
+                                 uint32_t* sampleCounts,
+                                 const Scene& scene,
+                                 const Camera& camera,
+                                 const RenderSettings& settings,
+                                 TileScheduler& scheduler) {
+    if (settings.wavefront) {
+        WavefrontIntegrator::accumulateSamples(accumulation, sampleCounts, scene, camera, settings, scheduler);
+        return;
     }
-
-    return localColor;
+    if (settings.heroWavelengths)
+        accumulateTilesForDepth<HeroWavelengthPath>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+    else
+        accumulateTilesForDepth<FullSpectrumPath>(accumulation, sampleCounts, scene, camera, settings, scheduler);
 }
 
-void Renderer::renderImage(uint32_t* pixels,
-                           const Scene& scene,
-                           const glm::vec3& camPos,
-                           const glm::vec3& forward,
-                           const glm::vec3& right,
-                           const glm::vec3& up) {
-
-    float aspectRatio = static_cast<float>(WIDTH) / HEIGHT;
-
-    // Declare the variables before the parallel region
-    int x, y;                // Loop indices
-    Spectrum pixelSpectrum;  // To store the color value per pixel
-    float offsetX, offsetY;  // Jitter offsets for each sample
-    float imageX, imageY;    // Image coordinates for ray casting
-    glm::vec3 rayDir;        // Ray direction
-    glm::vec3 rgbColor;       // Convert from spectrum to RGB
-
-    #pragma omp parallel for collapse(2) schedule(dynamic) default(none) \
-    shared(scale, aspectRatio, pixels, scene, camPos, forward, right, up, samplesPerPixel) \
-    private(x, y, pixelSpectrum, offsetX, offsetY, imageX, imageY, rayDir, rgbColor)
-        for (y = 0; y < HEIGHT; y++) {
-            for (x = 0; x < WIDTH; x++) {
-                // Average multiple samples.
-                for (int s = 0; s < samplesPerPixel; s++) {
-                    // Jitter the ray within the pixel.
-                    offsetX = random_float();
-                    offsetY = random_float();
-                    imageX = (2.0f * ((x + offsetX) / (float)WIDTH) - 1.0f) * aspectRatio * scale;
-                    imageY = (1.0f - 2.0f * ((y + offsetY) / (float)HEIGHT)) * scale;
-                    rayDir = glm::normalize(forward + right * imageX + up * imageY);
-                    pixelSpectrum += traceRaySpectral(camPos, rayDir, 0, scene);
-                }
-                pixelSpectrum *= (1.0f / samplesPerPixel);
+void Renderer::renderImage(uint32_t* pixels, const Scene& scene, const Camera& camera,
+                           const RenderSettings& settings) {
+    const int pixelCount = settings.width * settings.height;
+    std::vector<Spectrum> accumulation(pixelCount);
+    std::vector<uint32_t> sampleCounts(pixelCount, 0);
+    TileScheduler scheduler(settings.width, settings.height, settings.tileSize);
+    scheduler.setSampleBudget(settings.samplesPerPixel);
+    accumulateSamples(accumulation.data(), sampleCounts.data(), scene, camera, settings, scheduler);
+
+    #pragma omp parallel for
+    for (int i = 0; i < pixelCount; i++)
+        pixels[i] = toARGB(accumulation[i] * (1.0f / sampleCounts[i]));
+}
 
-                // Convert spectrum to RGB for display
-                rgbColor = pixelSpectrum.toRGB();
+uint32_t Renderer::toARGB(const Spectrum& spectrum) {
+    // Convert spectrum to RGB for display
+    glm::vec3 rgbColor = spectrum.toRGB();
 
-                // Pack the color into a pixel (assuming ARGB format).
-                pixels[y * WIDTH + x] = (255 << 24) |
-                                        (static_cast<int>(glm::clamp(rgbColor.r, 0.0f, 1.0f) * 255) << 16) |
-                                        (static_cast<int>(glm::clamp(rgbColor.g, 0.0f, 1.0f) * 255) << 8) |
-                                        static_cast<int>(glm::clamp(rgbColor.b, 0.0f, 1.0f) * 255);
-            }
-        }
-}
\ No newline at end of file
+    // Pack the color into a pixel (assuming ARGB format).
+    return (255u << 24) |
+           (static_cast<uint32_t>(glm::clamp(rgbColor.r, 0.0f, 1.0f) * 255) << 16) |
+           (static_cast<uint32_t>(glm::clamp(rgbColor.g, 0.0f, 1.0f) * 255) << 8) |
+           static_cast<uint32_t>(glm::clamp(rgbColor.b, 0.0f, 1.0f) * 255);
+}
@@ -8,24 +8,53 @@
 #include <cstdint>
 #include <glm/glm.hpp>
 
+#include "RenderSettings.h"
 #include "Scene.h"
+#include "SpectralData.h"
+#include "TileScheduler.h"
+
+// Pinhole camera given by its position and orthonormal basis.
+struct Camera {
+    glm::vec3 position;
+    glm::vec3 forward;
+    glm::vec3 right;
+    glm::vec3 up;
+
+    static Camera lookAt(const glm::vec3& position, const glm::vec3& target, const glm::vec3& worldUp) {
+        Camera camera;
+        camera.position = position;
+        camera.forward = glm::normalize(target - position);
+        camera.right = glm::normalize(glm::cross(camera.forward, worldUp));
+        camera.up = glm::normalize(glm::cross(camera.right, camera.forward));
+        return camera;
+    }
+
+    bool operator==(const Camera& other) const {
+        return position == other.position && forward == other.forward &&
+               right == other.right && up == other.up;
+    }
+};
 
 // Renderer class encapsulating the raytracing function.
 class Renderer {
 public:
-    static constexpr int WIDTH = 800;
-    static constexpr int HEIGHT = 600;
-
-    // Renders the scene to the pixel buffer.
-    // camPos, forward, right, and up define the camera coordinate system.
-    static void renderImage(uint32_t* pixels,
-                            const Scene& scene,
-                            const glm::vec3& camPos,
-                            const glm::vec3& forward,
-                            const glm::vec3& right,
-                            const glm::vec3& up);
+    // Renders every tile of the scheduler, tracing tile.sampleBudget more samples per pixel.
+    // accumulation holds the per-pixel spectrum sums and sampleCounts how many samples each
+    // pixel has so far; samples are numbered by that count, so splitting a total over several
+    // calls gives the same result as one call. The image size comes from the scheduler.
+    static void accumulateSamples(Spectrum* accumulation,
+                                  uint32_t* sampleCounts,
+                                  const Scene& scene,
+                                  const Camera& camera,
+                                  const RenderSettings& settings,
+                                  TileScheduler& scheduler);
+
+    // Renders the scene at settings.samplesPerPixel to a width x height pixel buffer.
+    static void renderImage(uint32_t* pixels, const Scene& scene, const Camera& camera,
+                            const RenderSettings& settings);
+
+    // Converts a pixel's spectrum to packed ARGB for display.
+    static uint32_t toARGB(const Spectrum& spectrum);
 };
 
 #endif // RENDERER_H
-
-
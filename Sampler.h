@@ -0,0 +1,50 @@
+//
+// Created by alex on 3/18/25.
+//
+
+// Sampler.h
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Counter-based random number source. Every value is a hash of (seed, pixel, sample, dimension),
+// so a sampler is only a few bytes on the stack, needs no shared state between threads,
+// and a pixel gets the same numbers no matter which thread renders it or in what order.
+class Sampler {
+public:
+    Sampler(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t seed = 0)
+        : key(mix64((static_cast<uint64_t>(pixelIndex) << 32 | sampleIndex) ^ ((seed + 1ull) * 0x9E3779B97F4A7C15ull))) {}
+
+    // Returns a float in [0, 1) and advances to the next dimension.
+    float get1D() {
+        uint64_t h = mix64(key + static_cast<uint64_t>(dimension++) * 0xD1B54A32D192ED03ull);
+        // Top 24 bits, so the result is exactly representable and never rounds up to 1.
+        return static_cast<float>(h >> 40) * 0x1p-24f;
+    }
+
+    glm::vec2 get2D() {
+        float u = get1D();
+        float v = get1D();
+        return glm::vec2(u, v);
+    }
+
+    uint32_t getDimension() const { return dimension; }
+
+private:
+    uint64_t key;
+    uint32_t dimension = 0;
+
+    // SplitMix64 finalizer.
+    static uint64_t mix64(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        return x;
+    }
+};
+
+#endif // SAMPLER_H
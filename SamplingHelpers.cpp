@@ -2,22 +2,15 @@
 // Created by alex on 3/10/25.
 //
 
+#include <algorithm>
 #include <cmath>
-#include <random>
 #include <glm/glm.hpp>
 #include "SamplingHelpers.h"
 
-// Returns a random float in [0, 1).
-float random_float() {
-    static std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-    static std::mt19937 generator(std::random_device{}());
-    return distribution(generator);
-}
-
 // Generates a random unit vector in the hemisphere defined by the normal.
-glm::vec3 random_in_hemisphere(const glm::vec3 &normal) {
-    float u = random_float();
-    float v = random_float();
+glm::vec3 random_in_hemisphere(const glm::vec3 &normal, Sampler& sampler) {
+    float u = sampler.get1D();
+    float v = sampler.get1D();
     float theta = 2.0f * M_PI * u;
     float phi = acos(2.0f * v - 1.0f);
 
@@ -31,3 +24,24 @@ glm::vec3 random_in_hemisphere(const glm::vec3 &normal) {
         randomDir = -randomDir;
     return glm::normalize(randomDir);
 }
+
+glm::vec3 sampleCosineHemisphere(const glm::vec2& u) {
+    // Map [0,1)^2 to [-1,1)^2, then squares onto concentric rings (Shirley-Chiu) so
+    // strata stay compact and no acos is needed.
+    float sx = 2.0f * u.x - 1.0f;
+    float sy = 2.0f * u.y - 1.0f;
+    if (sx == 0.0f && sy == 0.0f)
+        return glm::vec3(0.0f, 0.0f, 1.0f);
+
+    float r, theta;
+    if (std::abs(sx) > std::abs(sy)) {
+        r = sx;
+        theta = static_cast<float>(M_PI / 4.0) * (sy / sx);
+    } else {
+        r = sy;
+        theta = static_cast<float>(M_PI / 2.0) - static_cast<float>(M_PI / 4.0) * (sx / sy);
+    }
+    float x = r * std::cos(theta);
+    float y = r * std::sin(theta);
+    return glm::vec3(x, y, std::sqrt(std::max(0.0f, 1.0f - x * x - y * y)));
+}
@@ -6,9 +6,48 @@
 #define SAMPLINGHEADERS_H
 
 #include <glm/glm.hpp>
+#include <cmath>
+#include "Sampler.h"
 
-float random_float();
+glm::vec3 random_in_hemisphere(const glm::vec3 &normal, Sampler& sampler);
 
-glm::vec3 random_in_hemisphere(const glm::vec3 &normal);
+// Orthonormal basis around a unit normal, built without normalizations or branches on
+// the normal's largest axis (Duff et al., "Building an Orthonormal Basis, Revisited").
+struct OrthonormalBasis {
+    glm::vec3 tangent, bitangent, normal;
+
+    explicit OrthonormalBasis(const glm::vec3& n) : normal(n) {
+        float sign = std::copysign(1.0f, n.z);
+        float a = -1.0f / (sign + n.z);
+        float b = n.x * n.y * a;
+        tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+        bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+    }
+
+    glm::vec3 toWorld(const glm::vec3& local) const {
+        return tangent * local.x + bitangent * local.y + normal * local.z;
+    }
+};
+
+// Area density converted to solid angle density as seen from refPoint.
+inline float areaToSolidAnglePdf(float areaPdf, const glm::vec3& refPoint, const glm::vec3& lightPoint,
+                                 const glm::vec3& lightNormal) {
+    glm::vec3 toLight = lightPoint - refPoint;
+    float distanceSquared = glm::dot(toLight, toLight);
+    float cosine = std::abs(glm::dot(lightNormal, toLight)) / std::sqrt(distanceSquared);
+    return cosine > 0.0f ? areaPdf * distanceSquared / cosine : 0.0f;
+}
+
+// Power heuristic (beta = 2) MIS weight of a sample drawn with density pdfA when the
+// same direction could also have been drawn with density pdfB.
+inline float powerHeuristic(float pdfA, float pdfB) {
+    float a = pdfA * pdfA;
+    float b = pdfB * pdfB;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+// Cosine-weighted direction around +z, from a concentric disk mapping of u projected up
+// onto the hemisphere. The pdf of the result is z / pi.
+glm::vec3 sampleCosineHemisphere(const glm::vec2& u);
 
 #endif //SAMPLINGHEADERS_H
@@ -0,0 +1,303 @@
+//
+// Created by alex on 3/29/25.
+//
+
+// Scene.cpp
+#include "Scene.h"
+#include "Sampler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+void Scene::recordPrimitiveSlots() {
+    const uint32_t triangleCount = static_cast<uint32_t>(primitives.triangles.size());
+    for (auto& slots : slotPrimitives)
+        slots.clear();
+    for (uint32_t index : bvh->primIndices) {
+        if (index < triangleCount)
+            slotPrimitives[0].push_back(index);
+        else
+            slotPrimitives[1].push_back(index - triangleCount);
+    }
+    for (int type = 0; type < 2; type++) {
+        primitiveSlots[type].assign(slotPrimitives[type].size(), 0);
+        for (uint32_t slot = 0; slot < slotPrimitives[type].size(); slot++)
+            primitiveSlots[type][slotPrimitives[type][slot]] = slot;
+        dirtyPrimitives[type].clear();
+    }
+    fullRebuild = false;
+    lightsChanged = false;
+}
+
+bool Scene::updateEntity(size_t index) {
+    // The cache skips loading meshes and sphere files, so rebuilding from entities would drop them.
+    if (cacheFile) {
+        std::cerr << "Cannot edit a scene loaded from a scene cache\n";
+        return false;
+    }
+
+    Entity& entity = *entities[index];
+    entity.geometryChanged();
+    if (materials[entity.getMaterialId()].isEmissive())
+        lightsChanged = true;
+    if (fullRebuild)
+        return true;
+
+    PrimitivePools edited;
+    entity.addToPools(edited);
+    if (index >= entityPrimitives.size() ||
+        primitiveSlots[0].size() != primitives.triangles.size() ||
+        primitiveSlots[1].size() != primitives.spheres.size()) {
+        fullRebuild = true;
+        return true;
+    }
+    const PrimitiveRange& range = entityPrimitives[index];
+    if (edited.triangles.size() != range.triangleCount || edited.spheres.size() != range.sphereCount) {
+        fullRebuild = true;
+        return true;
+    }
+
+    for (uint32_t i = 0; i < range.triangleCount; i++) {
+        uint32_t slot = primitiveSlots[0][range.firstTriangle + i];
+        primitives.copyTriangle(slot, edited, i);
+        dirtyPrimitives[0].push_back(slot);
+    }
+    for (uint32_t i = 0; i < range.sphereCount; i++) {
+        uint32_t slot = primitiveSlots[1][range.firstSphere + i];
+        primitives.copySphere(slot, edited, i);
+        dirtyPrimitives[1].push_back(slot);
+    }
+    return true;
+}
+
+void Scene::updateBVH() {
+    if (!bvh || !wideBVH)
+        return;
+    if (fullRebuild) {
+        buildBVH();
+        return;
+    }
+
+    if (!dirtyPrimitives[0].empty() || !dirtyPrimitives[1].empty()) {
+        bvh->prepareRefit();
+        std::vector<uint32_t> leaves;
+        for (int type = 0; type < 2; type++) {
+            for (uint32_t slot : dirtyPrimitives[type])
+                leaves.push_back(bvh->leafOf(static_cast<PrimitiveType>(type), slot));
+            dirtyPrimitives[type].clear();
+        }
+        std::vector<uint32_t> refitted;
+        bvh->refit(primitives, std::move(leaves), refitted);
+        wideBVH->refit(*bvh, refitted);
+
+        // A binary subtree can only be swapped out where a wide node starts, so each
+        // degraded node is rebuilt from the nearest such ancestor.
+        std::vector<uint32_t> roots;
+        for (uint32_t node : bvh->degradedSubtrees(refitted)) {
+            while (!wideBVH->isSubtreeRoot(node))
+                node = bvh->parent(node);
+            roots.push_back(node);
+        }
+        std::sort(roots.begin(), roots.end());
+        roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+        // Mark roots nested under another root while roots is still sorted, then drop them.
+        std::vector<char> nested(roots.size(), 0);
+        for (size_t i = 0; i < roots.size(); i++) {
+            for (uint32_t above = bvh->parent(roots[i]); above != BVH::NO_NODE; above = bvh->parent(above)) {
+                if (std::binary_search(roots.begin(), roots.end(), above)) {
+                    nested[i] = 1;
+                    break;
+                }
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < roots.size(); i++) {
+            if (!nested[i])
+                roots[kept++] = roots[i];
+        }
+        roots.resize(kept);
+        if (!roots.empty() && roots.front() == 0) {
+            buildBVH();
+            return;
+        }
+
+        for (uint32_t root : roots) {
+            BVH::SubtreeOrder order;
+            if (!bvh->rebuildSubtree(root, primitives, order)) {
+                buildBVH();
+                return;
+            }
+            for (int type = 0; type < 2; type++) {
+                const std::vector<uint32_t>& moved = order.order[type];
+                if (moved.empty())
+                    continue;
+                const uint32_t first = order.first[type];
+                primitives.permute(static_cast<PrimitiveType>(type), first, moved);
+                std::vector<uint32_t> owners(moved.size());
+                for (size_t i = 0; i < moved.size(); i++)
+                    owners[i] = slotPrimitives[type][first + moved[i]];
+                for (uint32_t i = 0; i < owners.size(); i++) {
+                    slotPrimitives[type][first + i] = owners[i];
+                    primitiveSlots[type][owners[i]] = first + i;
+                }
+            }
+            wideBVH->replaceSubtree(*bvh, root);
+        }
+
+        // Each rebuild strands the nodes it replaced; compact once they are half the tree.
+        if (bvh->unreachableNodes() > bvh->nodes.size() / 2) {
+            buildBVH();
+            return;
+        }
+        assert(validateBVH() && "incremental BVH update differs from a rebuild");
+    }
+
+    if (lightsChanged) {
+        buildLightSampler();
+        lightsChanged = false;
+    }
+}
+
+namespace {
+
+AABB slotBounds(const WideBVHNode& node, int slot) {
+    return AABB(glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]),
+                glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]));
+}
+
+bool sameBounds(const AABB& a, const AABB& b) {
+    return a.min == b.min && a.max == b.max;
+}
+
+// Union of the bounds of a leaf's primitives. Adds one to the coverage of each of its slots.
+AABB leafBounds(const PrimitivePools& primitives, uint8_t type, uint32_t first, uint32_t count,
+                std::vector<uint32_t> (&covered)[2]) {
+    AABB bounds;
+    for (uint32_t i = first; i < first + count; i++) {
+        bounds.expand(primitives.bounds(static_cast<PrimitiveType>(type), i));
+        covered[type][i]++;
+    }
+    return bounds;
+}
+
+} // namespace
+
+bool Scene::validateBVH() const {
+    if (!bvh || !wideBVH || bvh->nodes.empty())
+        return true;
+    auto fail = [](const char* what) {
+        std::cerr << "BVH validation failed: " << what << "\n";
+        return false;
+    };
+
+    // The entities' current geometry, numbered as collectPrimitives numbers it.
+    PrimitivePools fresh;
+    for (const auto& entity : entities)
+        entity->addToPools(fresh);
+    const size_t poolSizes[2] = { primitives.triangles.size(), primitives.spheres.size() };
+    if (fresh.triangles.size() != poolSizes[0] || fresh.spheres.size() != poolSizes[1])
+        return fail("pool sizes differ from the entities");
+    for (int type = 0; type < 2; type++) {
+        if (slotPrimitives[type].size() != poolSizes[type])
+            return fail("slot map size differs from the pool");
+        for (uint32_t slot = 0; slot < poolSizes[type]; slot++) {
+            const PrimitiveType primitiveType = static_cast<PrimitiveType>(type);
+            if (!sameBounds(primitives.bounds(primitiveType, slot),
+                            fresh.bounds(primitiveType, slotPrimitives[type][slot])))
+                return fail("pool slot holds stale geometry");
+        }
+    }
+
+    // Binary BVH: each node bounds exactly what is below it, each slot is in one leaf.
+    std::vector<uint32_t> covered[2] = { std::vector<uint32_t>(poolSizes[0]), std::vector<uint32_t>(poolSizes[1]) };
+    std::vector<AABB> expected(bvh->nodes.size());
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        order.push_back(index);
+        const BVHNode& node = bvh->nodes[index];
+        if (node.isLeaf()) {
+            expected[index] = leafBounds(primitives, node.type, node.offset, node.count, covered);
+        } else {
+            stack.push_back(index + 1);
+            stack.push_back(node.offset);
+        }
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        const BVHNode& node = bvh->nodes[*it];
+        if (!node.isLeaf()) {
+            expected[*it] = expected[*it + 1];
+            expected[*it].expand(expected[node.offset]);
+        }
+        if (!sameBounds(node.bounds, expected[*it]))
+            return fail("binary node bounds are not the union of their contents");
+    }
+    for (const auto& counts : covered) {
+        if (std::any_of(counts.begin(), counts.end(), [](uint32_t c) { return c != 1; }))
+            return fail("binary leaves do not cover every pool slot exactly once");
+    }
+
+    // Wide BVH: the same, with leaves in the child slots.
+    for (auto& counts : covered)
+        std::fill(counts.begin(), counts.end(), 0);
+    std::vector<std::pair<uint32_t, AABB>> wideStack = { { 0, bvh->nodes[0].bounds } };
+    while (!wideStack.empty()) {
+        auto [index, parentBounds] = wideStack.back();
+        wideStack.pop_back();
+        const WideBVHNode& node = wideBVH->nodes[index];
+        AABB bounds;
+        for (int slot = 0; slot < node.childCount; slot++) {
+            AABB childBounds = slotBounds(node, slot);
+            bounds.expand(childBounds);
+            if (node.count[slot] > 0) {
+                if (!sameBounds(childBounds, leafBounds(primitives, node.type[slot], node.child[slot],
+                                                        node.count[slot], covered)))
+                    return fail("wide leaf bounds are not the union of their primitives");
+            } else {
+                wideStack.push_back({ node.child[slot], childBounds });
+            }
+        }
+        if (!sameBounds(bounds, parentBounds))
+            return fail("wide node bounds are not the union of their children");
+    }
+    for (const auto& counts : covered) {
+        if (std::any_of(counts.begin(), counts.end(), [](uint32_t c) { return c != 1; }))
+            return fail("wide leaves do not cover every pool slot exactly once");
+    }
+
+    // Probe rays through both updated trees and a fresh build must stop at the same distance.
+    std::vector<AABB> bounds;
+    std::vector<uint8_t> types;
+    fresh.collectBounds(bounds, types);
+    const BVH referenceBVH(bounds, types);
+    fresh.reorder(referenceBVH.primIndices);
+    const WideBVH referenceWideBVH(referenceBVH);
+    if (!sameBounds(referenceBVH.nodes[0].bounds, bvh->nodes[0].bounds))
+        return fail("root bounds differ from a fresh build");
+
+    const AABB& root = referenceBVH.nodes[0].bounds;
+    for (uint32_t ray = 0; ray < VALIDATION_RAYS; ray++) {
+        Sampler sampler(ray, 0);
+        glm::vec3 u(sampler.get1D(), sampler.get1D(), sampler.get1D());
+        glm::vec3 origin = root.min + root.extent() * u;
+        glm::vec3 dir(sampler.get1D() - 0.5f, sampler.get1D() - 0.5f, sampler.get1D() - 0.5f);
+        if (glm::dot(dir, dir) == 0.0f)
+            continue;
+        dir = glm::normalize(dir);
+
+        HitRecord reference, binary, wide;
+        reference.t = binary.t = wide.t = std::numeric_limits<float>::infinity();
+        bool referenceHit = referenceWideBVH.intersect(fresh, origin, dir, reference);
+        bool binaryHit = bvh->intersect(primitives, origin, dir, binary);
+        bool wideHit = wideBVH->intersect(primitives, origin, dir, wide);
+        if (binaryHit != referenceHit || wideHit != referenceHit)
+            return fail("a probe ray hits differently than through a fresh build");
+        const float tolerance = 1e-5f * std::max(1.0f, reference.t);
+        if (referenceHit && (std::abs(binary.t - reference.t) > tolerance || std::abs(wide.t - reference.t) > tolerance))
+            return fail("a probe ray stops at a different distance than through a fresh build");
+    }
+    return true;
+}
@@ -8,22 +8,198 @@
 
 #include <vector>
 #include <memory>
+#include <limits>
 #include "Entity.h"
-#include "BVHNode.h"
+#include "MaterialTable.h"
+#include "LightSampler.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "MappedFile.h"
 
 class Scene {
 public:
     std::vector<std::shared_ptr<Entity>> entities;
-    std::shared_ptr<BVHNode> bvh;
+    std::vector<std::shared_ptr<Entity>> lights;   // Entities with an emissive material.
+    LightSampler lightSampler;                     // Picks one part of lights per shading point.
+    MaterialTable materials;
+    PrimitivePools primitives;          // Geometry of all entities in per-type pools, in BVH order.
+    std::shared_ptr<BVH> bvh;
+    std::shared_ptr<WideBVH> wideBVH;   // Collapsed from bvh; used for traversal.
+    std::shared_ptr<MappedFile> cacheFile;   // Keeps a loaded scene cache mapped; the pools and BVHs view it.
+
+    // Primitives an entity added to the pools, numbered in entity order as collectPrimitives
+    // adds them, before the pools are reordered for the BVH.
+    struct PrimitiveRange {
+        uint32_t firstTriangle = 0;
+        uint32_t triangleCount = 0;
+        uint32_t firstSphere = 0;
+        uint32_t sphereCount = 0;
+    };
+    std::vector<PrimitiveRange> entityPrimitives;   // One per entity.
+
+    // Flattens every entity into the primitive pools, in entity order, and tags the
+    // primitives of lights with their LightSampler emitter index.
+    void collectPrimitives() {
+        primitives.clear();
+        entityPrimitives.clear();
+        uint32_t emitterCount = 0;
+        for (const auto& entity : entities) {
+            size_t firstTriangle = primitives.triangles.size();
+            size_t firstSphere = primitives.spheres.size();
+            entity->addToPools(primitives);
+            entityPrimitives.push_back({ static_cast<uint32_t>(firstTriangle),
+                                         static_cast<uint32_t>(primitives.triangles.size() - firstTriangle),
+                                         static_cast<uint32_t>(firstSphere),
+                                         static_cast<uint32_t>(primitives.spheres.size() - firstSphere) });
+            if (materials[entity->getMaterialId()].isEmissive()) {
+                const uint32_t parts = entity->lightPartCount();
+                primitives.setLightIndex(firstTriangle, firstSphere, emitterCount, parts > 1);
+                emitterCount += parts;
+            }
+        }
+    }
 
     void buildBVH() {
-        bvh = std::make_shared<BVHNode>(entities);
+        collectPrimitives();
+
+        std::vector<AABB> bounds;
+        std::vector<uint8_t> types;
+        primitives.collectBounds(bounds, types);
+        bvh = std::make_shared<BVH>(bounds, types);
+        primitives.reorder(bvh->primIndices);
+        wideBVH = std::make_shared<WideBVH>(*bvh);
+        cacheFile.reset();   // Nothing views a loaded scene cache any more.
+        recordPrimitiveSlots();
+        buildLightSampler();
+    }
+
+    // Copies the current geometry of entities[index], edited in place, into the pools.
+    // The BVH is only brought up to date by updateBVH, so a batch of edits is refitted
+    // once. An entity that gained or lost primitives, or was added after the last build,
+    // makes the next updateBVH rebuild everything. Fails for a scene loaded from a scene
+    // cache, whose entities do not hold the geometry of the cached files.
+    bool updateEntity(size_t index);
+
+    // Refits the BVHs to the entities passed to updateEntity since the last update, then
+    // rebuilds the subtrees whose SAH cost grew past BVH::REBUILD_THRESHOLD. Must not run
+    // while a frame is being traced.
+    void updateBVH();
+
+    // Checks the BVHs updateBVH left behind against a fresh build from the entities: the
+    // pools must hold every entity's current geometry, both trees must cover every pool
+    // slot exactly once with bounds that are exactly the union of what they contain, and
+    // probe rays must hit at the same distances as through the fresh build. Reports the
+    // first mismatch on stderr. Run after every update in debug builds.
+    bool validateBVH() const;
+
+    static constexpr uint32_t VALIDATION_RAYS = 4096;   // Probe rays of validateBVH.
+
+    // Rebuilds the light sampler from lights and their materials.
+    void buildLightSampler() {
+        lightSampler = LightSampler(lights, materials);
     }
 
-    // Add a new entity to the scene
+    // Add a new entity to the scene. Its material must already be in the table.
     void addEntity(const std::shared_ptr<Entity>& entity) {
         entities.push_back(entity);
+        if (materials[entity->getMaterialId()].isEmissive())
+            lights.push_back(entity);
     }
+
+    // Closest hit along the ray, through the BVH when it has been built.
+    bool intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
+        if (wideBVH)
+            return wideBVH->intersect(primitives, origin, dir, rec);
+        if (bvh)
+            return bvh->intersect(primitives, origin, dir, rec);
+
+        // Fallback to a linear loop if BVH not built
+        const Entity* hitEntity = nullptr;
+        float closest = std::numeric_limits<float>::infinity();
+        for (const auto& entity : entities) {
+            HitRecord tmp;
+            if (entity->intersect(origin, dir, tmp) && tmp.t < closest) {
+                closest = tmp.t;
+                rec = tmp;
+                hitEntity = entity.get();
+            }
+        }
+        uint32_t firstEmitter = 0;
+        for (size_t i = 0; hitEntity && i < lights.size(); i++) {
+            const uint32_t parts = lights[i]->lightPartCount();
+            if (lights[i].get() == hitEntity)
+                rec.lightIndex = firstEmitter + (parts > 1 ? rec.primitiveIndex : 0);
+            firstEmitter += parts;
+        }
+        return hitEntity != nullptr;
+    }
+
+    // Closest hits of a packet of rays from one origin; returns a mask of the rays that hit.
+    // Packets go through the binary BVH, which the packet traversal is written for.
+    uint32_t intersect(const RayPacket& packet, HitRecord* records) const {
+        if (bvh)
+            return bvh->intersect(primitives, packet, records);
+
+        uint32_t found = 0;
+        for (int i = 0; i < packet.count; i++) {
+            if (intersect(packet.origin, packet.direction(i), records[i]))
+                found |= 1u << i;
+        }
+        return found;
+    }
+
+    // Closest hits of a batch of rays with their own origins, each within its own tMax;
+    // returns a mask of the rays that hit. Batches go through the binary BVH like packets.
+    uint32_t intersect(const RayBatch& batch, HitRecord* records) const {
+        if (bvh)
+            return bvh->intersect(primitives, batch, records);
+
+        uint32_t found = 0;
+        for (int i = 0; i < batch.count; i++) {
+            if (intersect(batch.origin(i), batch.direction(i), records[i]) && records[i].t < batch.tMax[i])
+                found |= 1u << i;
+        }
+        return found;
+    }
+
+    // Mask of the rays of batch that something blocks before their tMax.
+    uint32_t occluded(const RayBatch& batch) const {
+        if (bvh)
+            return bvh->occluded(primitives, batch);
+
+        uint32_t blocked = 0;
+        for (int i = 0; i < batch.count; i++) {
+            if (occluded(batch.origin(i), batch.direction(i), batch.tMax[i]))
+                blocked |= 1u << i;
+        }
+        return blocked;
+    }
+
+    // True if anything blocks the ray before tMax. Used for shadow rays.
+    bool occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+        if (wideBVH)
+            return wideBVH->occluded(primitives, origin, dir, tMax);
+        if (bvh)
+            return bvh->occluded(primitives, origin, dir, tMax);
+
+        for (const auto& entity : entities) {
+            if (entity->occluded(origin, dir, tMax))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    // Per PrimitiveType, the pool slot of each primitive in collectPrimitives numbering,
+    // and the inverse. Set by buildBVH.
+    std::vector<uint32_t> primitiveSlots[2];
+    std::vector<uint32_t> slotPrimitives[2];
+    std::vector<uint32_t> dirtyPrimitives[2];   // Pool slots updateEntity rewrote.
+    bool fullRebuild = false;
+    bool lightsChanged = false;
+
+    // Fills the slot maps from the order buildBVH put the pools in.
+    void recordPrimitiveSlots();
 };
 
 #endif // SCENE_H
@@ -0,0 +1,423 @@
+//
+// Created by alex on 3/26/25.
+//
+
+// SceneCache.cpp
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// File layout: a header, a table of SECTION_COUNT sections, then the section data.
+// Every section starts on a SECTION_ALIGNMENT boundary, so once the file is mapped
+// (mappings are page aligned) each one can be used directly as a typed array.
+constexpr char MAGIC[8] = { 'S', 'R', 'T', 'S', 'C', 'E', 'N', 'E' };
+constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+enum Section : uint32_t {
+    TRIANGLE_V0X, TRIANGLE_V0Y, TRIANGLE_V0Z,
+    TRIANGLE_E1X, TRIANGLE_E1Y, TRIANGLE_E1Z,
+    TRIANGLE_E2X, TRIANGLE_E2Y, TRIANGLE_E2Z,
+    TRIANGLE_MATERIAL, TRIANGLE_ATTRIBUTES, TRIANGLE_LIGHT,
+    SPHERE_CX, SPHERE_CY, SPHERE_CZ, SPHERE_RADIUS, SPHERE_MATERIAL, SPHERE_LIGHT,
+    VERTEX_NORMALS, VERTEX_UVS, VERTEX_CORNERS,
+    MATERIALS,
+    BVH_NODES, WIDE_BVH_NODES,
+    SECTION_COUNT
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t key;
+    BVHBuildStats stats;
+};
+
+struct CacheSection {
+    uint64_t offset;        // From the start of the file.
+    uint64_t count;
+    uint32_t elementSize;
+    uint32_t reserved;
+};
+
+// Materials are stored for validation only: BSDFs are objects owned by the scene
+// description, so a cache is only used with the table it was written from.
+struct CachedMaterial {
+    float color[SPECTRAL_SAMPLES];
+    float emission[SPECTRAL_SAMPLES];
+    uint32_t hasBSDF;
+};
+
+static_assert(std::is_trivially_copyable_v<BVHNode> && std::is_trivially_copyable_v<WideBVHNode>,
+              "BVH nodes are written to the cache as raw bytes");
+
+class Hasher {
+public:
+    void mix(const void* data, size_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            h ^= bytes[i];
+            h *= 0x100000001B3ull;
+        }
+    }
+
+    template <typename T>
+    void mix(const T& value) { mix(&value, sizeof(T)); }
+
+    template <typename T>
+    void mix(const Buffer<T>& values) {
+        mix(values.size());
+        mix(values.data(), values.size() * sizeof(T));
+    }
+
+    uint64_t value() const { return h; }
+
+private:
+    uint64_t h = 0xCBF29CE484222325ull;
+};
+
+CachedMaterial toCached(const Material& material) {
+    CachedMaterial cached = {};
+    std::memcpy(cached.color, material.color.samples.data(), sizeof(cached.color));
+    std::memcpy(cached.emission, material.emission.samples.data(), sizeof(cached.emission));
+    cached.hasBSDF = material.bsdf != nullptr;
+    return cached;
+}
+
+// Raw bytes of one section, in the order of the Section enum.
+struct SectionData {
+    const void* data;
+    uint64_t count;
+    uint32_t elementSize;
+};
+
+template <typename T>
+SectionData section(const Buffer<T>& values) {
+    return { values.data(), values.size(), sizeof(T) };
+}
+
+template <typename T>
+SectionData section(const std::vector<T>& values) {
+    return { values.data(), values.size(), sizeof(T) };
+}
+
+// Points buffer at the section if it holds elements of type T.
+template <typename T>
+bool viewSection(const MappedFile& file, const CacheSection& entry, Buffer<T>& buffer) {
+    if (entry.elementSize != sizeof(T) || entry.offset % SECTION_ALIGNMENT != 0 ||
+        entry.offset > file.size() || entry.count > (file.size() - entry.offset) / sizeof(T))
+        return false;
+    buffer = Buffer<T>::view(reinterpret_cast<const T*>(file.data() + entry.offset), entry.count);
+    return true;
+}
+
+// True if a leaf of count primitives of type starting at first lies inside its pool.
+bool validLeaf(const PrimitivePools& pools, uint32_t first, uint32_t count, uint8_t type) {
+    if (type > static_cast<uint8_t>(PrimitiveType::Sphere) || count > BVH::MAX_LEAF_SIZE)
+        return false;
+    const size_t poolSize = type == static_cast<uint8_t>(PrimitiveType::Triangle) ? pools.triangles.size()
+                                                                                   : pools.spheres.size();
+    return static_cast<uint64_t>(first) + count <= poolSize;
+}
+
+// Walks the binary BVH from the root like traversal does: every child index must be a
+// node, every node reached once, no deeper than the traversal stacks and every leaf
+// inside its pool.
+bool validBVH(const BVH& bvh, const PrimitivePools& pools) {
+    const size_t count = bvh.nodes.size();
+    if (count == 0)
+        return true;
+    std::vector<uint8_t> reached(count, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+        if (index >= count || reached[index] || depth > BVH::MAX_DEPTH)
+            return false;
+        reached[index] = 1;
+        const BVHNode& node = bvh.nodes[index];
+        if (node.isLeaf()) {
+            if (!validLeaf(pools, node.offset, node.count, node.type))
+                return false;
+            continue;
+        }
+        stack.push_back({ index + 1, depth + 1 });
+        stack.push_back({ node.offset, depth + 1 });
+    }
+    return true;
+}
+
+// The same walk over the wide BVH, whose leaves are stored in its child slots.
+bool validWideBVH(const WideBVH& wideBVH, const PrimitivePools& pools) {
+    const size_t count = wideBVH.nodes.size();
+    if (count == 0)
+        return true;
+    std::vector<uint8_t> reached(count, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+        if (index >= count || reached[index] || depth > BVH::MAX_DEPTH)
+            return false;
+        reached[index] = 1;
+        const WideBVHNode& node = wideBVH.nodes[index];
+        if (node.childCount > WideBVHNode::WIDTH)
+            return false;
+        for (int slot = 0; slot < node.childCount; slot++) {
+            if (node.count[slot] > 0) {
+                if (!validLeaf(pools, node.child[slot], node.count[slot], node.type[slot]))
+                    return false;
+            } else {
+                stack.push_back({ node.child[slot], depth + 1 });
+            }
+        }
+    }
+    return true;
+}
+
+// True if every material, vertex attribute and emitter index in the pools points into
+// the table, attribute arrays and emitters it is used with.
+bool validPrimitiveIndices(const PrimitivePools& pools, size_t materialCount, size_t emitterCount) {
+    const TrianglePool& triangles = pools.triangles;
+    const SpherePool& spheres = pools.spheres;
+    const VertexAttributes& attributes = pools.attributes;
+    auto validLight = [&](uint32_t light) { return light == HitRecord::NO_LIGHT || light < emitterCount; };
+    for (size_t i = 0; i < triangles.size(); i++) {
+        if (triangles.materialIndex[i] >= materialCount || !validLight(triangles.lightIndex[i]))
+            return false;
+        const uint32_t first = triangles.attributeIndex[i];
+        if (first == TrianglePool::NO_ATTRIBUTES)
+            continue;
+        if (static_cast<uint64_t>(first) + 3 > attributes.corners.size())
+            return false;
+        for (uint32_t c = 0; c < 3; c++) {
+            const uint32_t vertex = attributes.corners[first + c];
+            if (vertex >= attributes.normals.size() || vertex >= attributes.uvs.size())
+                return false;
+        }
+    }
+    for (size_t i = 0; i < spheres.size(); i++) {
+        if (spheres.materialIndex[i] >= materialCount || !validLight(spheres.lightIndex[i]))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+uint64_t hashSceneInput(const Scene& scene, const std::vector<std::string>& inputFiles) {
+    Hasher hasher;
+    hasher.mix(SCENE_CACHE_VERSION);
+    hasher.mix(BVH::BIN_COUNT);
+    hasher.mix(BVH::MAX_LEAF_SIZE);
+    hasher.mix(BVH::LEAF_GROUP_SIZE);
+
+    const TrianglePool& triangles = scene.primitives.triangles;
+    for (const auto* values : { &triangles.v0x, &triangles.v0y, &triangles.v0z, &triangles.e1x, &triangles.e1y,
+                                &triangles.e1z, &triangles.e2x, &triangles.e2y, &triangles.e2z })
+        hasher.mix(*values);
+    hasher.mix(triangles.materialIndex);
+    hasher.mix(triangles.attributeIndex);
+    hasher.mix(triangles.lightIndex);
+
+    const SpherePool& spheres = scene.primitives.spheres;
+    for (const auto* values : { &spheres.cx, &spheres.cy, &spheres.cz, &spheres.radius })
+        hasher.mix(*values);
+    hasher.mix(spheres.materialIndex);
+    hasher.mix(spheres.lightIndex);
+
+    hasher.mix(scene.primitives.attributes.normals);
+    hasher.mix(scene.primitives.attributes.uvs);
+    hasher.mix(scene.primitives.attributes.corners);
+
+    for (const Material& material : scene.materials.getMaterials())
+        hasher.mix(toCached(material));
+
+    for (const std::string& path : inputFiles) {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        auto modified = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        hasher.mix(path.data(), path.size());
+        hasher.mix(size);
+        hasher.mix(modified);
+    }
+    return hasher.value();
+}
+
+std::string sceneCachePath(const std::string& directory, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.scene", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool loadSceneCache(const std::string& path, uint64_t key, Scene& scene) {
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+        return false;
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path))
+        return false;
+
+    CacheHeader header;
+    const uint64_t tableEnd = sizeof(CacheHeader) + SECTION_COUNT * sizeof(CacheSection);
+    if (file->size() < tableEnd)
+        return false;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != SCENE_CACHE_VERSION ||
+        header.sectionCount != SECTION_COUNT || header.key != key ||
+        header.stats.maxDepth > static_cast<uint32_t>(BVH::MAX_DEPTH))
+        return false;
+    const auto* sections = reinterpret_cast<const CacheSection*>(file->data() + sizeof(CacheHeader));
+
+    // The table the cache was written from must match the one primitives index into.
+    Buffer<CachedMaterial> cachedMaterials;
+    const std::vector<Material>& materials = scene.materials.getMaterials();
+    if (!viewSection(*file, sections[MATERIALS], cachedMaterials) || cachedMaterials.size() != materials.size())
+        return false;
+    for (size_t i = 0; i < materials.size(); i++) {
+        CachedMaterial expected = toCached(materials[i]);
+        if (std::memcmp(&expected, &cachedMaterials[i], sizeof(CachedMaterial)) != 0)
+            return false;
+    }
+
+    PrimitivePools pools;
+    TrianglePool& triangles = pools.triangles;
+    SpherePool& spheres = pools.spheres;
+    auto bvh = std::make_shared<BVH>();
+    auto wideBVH = std::make_shared<WideBVH>();
+    bool valid = viewSection(*file, sections[TRIANGLE_V0X], triangles.v0x) &&
+                 viewSection(*file, sections[TRIANGLE_V0Y], triangles.v0y) &&
+                 viewSection(*file, sections[TRIANGLE_V0Z], triangles.v0z) &&
+                 viewSection(*file, sections[TRIANGLE_E1X], triangles.e1x) &&
+                 viewSection(*file, sections[TRIANGLE_E1Y], triangles.e1y) &&
+                 viewSection(*file, sections[TRIANGLE_E1Z], triangles.e1z) &&
+                 viewSection(*file, sections[TRIANGLE_E2X], triangles.e2x) &&
+                 viewSection(*file, sections[TRIANGLE_E2Y], triangles.e2y) &&
+                 viewSection(*file, sections[TRIANGLE_E2Z], triangles.e2z) &&
+                 viewSection(*file, sections[TRIANGLE_MATERIAL], triangles.materialIndex) &&
+                 viewSection(*file, sections[TRIANGLE_ATTRIBUTES], triangles.attributeIndex) &&
+                 viewSection(*file, sections[TRIANGLE_LIGHT], triangles.lightIndex) &&
+                 viewSection(*file, sections[SPHERE_CX], spheres.cx) &&
+                 viewSection(*file, sections[SPHERE_CY], spheres.cy) &&
+                 viewSection(*file, sections[SPHERE_CZ], spheres.cz) &&
+                 viewSection(*file, sections[SPHERE_RADIUS], spheres.radius) &&
+                 viewSection(*file, sections[SPHERE_MATERIAL], spheres.materialIndex) &&
+                 viewSection(*file, sections[SPHERE_LIGHT], spheres.lightIndex) &&
+                 viewSection(*file, sections[VERTEX_NORMALS], pools.attributes.normals) &&
+                 viewSection(*file, sections[VERTEX_UVS], pools.attributes.uvs) &&
+                 viewSection(*file, sections[VERTEX_CORNERS], pools.attributes.corners) &&
+                 viewSection(*file, sections[BVH_NODES], bvh->nodes) &&
+                 viewSection(*file, sections[WIDE_BVH_NODES], wideBVH->nodes);
+    for (const auto* values : { &triangles.v0y, &triangles.v0z, &triangles.e1x, &triangles.e1y,
+                                &triangles.e1z, &triangles.e2x, &triangles.e2y, &triangles.e2z })
+        valid = valid && values->size() == triangles.size();
+    valid = valid && triangles.materialIndex.size() == triangles.size() &&
+            triangles.attributeIndex.size() == triangles.size() &&
+            triangles.lightIndex.size() == triangles.size() && spheres.lightIndex.size() == spheres.size() &&
+            spheres.cy.size() == spheres.size() && spheres.cz.size() == spheres.size() &&
+            spheres.radius.size() == spheres.size() && spheres.materialIndex.size() == spheres.size();
+
+    // The renderer follows every index in the file without checks, so a cache whose key
+    // matches but whose contents do not is rejected here rather than read out of bounds.
+    LightSampler lightSampler(scene.lights, scene.materials);
+    valid = valid && validBVH(*bvh, pools) && validWideBVH(*wideBVH, pools) &&
+            validPrimitiveIndices(pools, materials.size(), lightSampler.emitterCount());
+    if (!valid) {
+        std::cerr << "Scene cache " << path << " is corrupt\n";
+        return false;
+    }
+
+    scene.primitives = std::move(pools);
+    bvh->stats = header.stats;
+    scene.bvh = bvh;
+    scene.wideBVH = wideBVH;
+    scene.cacheFile = file;
+    // Light sampling only depends on the authored lights and is cheap to rebuild.
+    scene.lightSampler = std::move(lightSampler);
+    return true;
+}
+
+bool writeSceneCache(const std::string& path, uint64_t key, const Scene& scene) {
+    if (!scene.bvh || !scene.wideBVH) {
+        std::cerr << "Cannot cache a scene whose BVH has not been built\n";
+        return false;
+    }
+
+    std::vector<CachedMaterial> materials;
+    for (const Material& material : scene.materials.getMaterials())
+        materials.push_back(toCached(material));
+
+    const TrianglePool& triangles = scene.primitives.triangles;
+    const SpherePool& spheres = scene.primitives.spheres;
+    const VertexAttributes& attributes = scene.primitives.attributes;
+    const SectionData data[SECTION_COUNT] = {
+        section(triangles.v0x), section(triangles.v0y), section(triangles.v0z),
+        section(triangles.e1x), section(triangles.e1y), section(triangles.e1z),
+        section(triangles.e2x), section(triangles.e2y), section(triangles.e2z),
+        section(triangles.materialIndex), section(triangles.attributeIndex), section(triangles.lightIndex),
+        section(spheres.cx), section(spheres.cy), section(spheres.cz), section(spheres.radius),
+        section(spheres.materialIndex), section(spheres.lightIndex),
+        section(attributes.normals), section(attributes.uvs), section(attributes.corners),
+        section(materials),
+        section(scene.bvh->nodes), section(scene.wideBVH->nodes)
+    };
+
+    CacheHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = SCENE_CACHE_VERSION;
+    header.sectionCount = SECTION_COUNT;
+    header.key = key;
+    header.stats = scene.bvh->stats;
+
+    CacheSection sections[SECTION_COUNT] = {};
+    uint64_t offset = sizeof(CacheHeader) + sizeof(sections);
+    for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+        offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        sections[i] = { offset, data[i].count, data[i].elementSize, 0 };
+        offset += data[i].count * data[i].elementSize;
+    }
+
+    std::error_code error;
+    std::filesystem::path target(path);
+    if (target.has_parent_path())
+        std::filesystem::create_directories(target.parent_path(), error);
+
+    // Written next to the target and renamed, so a reader never maps a partial file.
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Cannot write scene cache " << temporary << "\n";
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sections), sizeof(sections));
+        const char padding[SECTION_ALIGNMENT] = {};
+        for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+            file.write(padding, static_cast<std::streamsize>(sections[i].offset - static_cast<uint64_t>(file.tellp())));
+            file.write(static_cast<const char*>(data[i].data),
+                       static_cast<std::streamsize>(data[i].count * data[i].elementSize));
+        }
+        if (!file) {
+            std::cerr << "Failed to write scene cache " << temporary << "\n";
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary, target, error);
+    if (error) {
+        std::cerr << "Cannot replace " << path << ": " << error.message() << "\n";
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+//
+// Created by alex on 3/26/25.
+//
+
+// SceneCache.h
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include "Scene.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bump whenever the file layout or the code that builds scenes changes, so old
+// caches are rebuilt instead of loaded.
+constexpr uint32_t SCENE_CACHE_VERSION = 4;
+
+// Hash of everything a built scene depends on: the primitive pools from
+// Scene::collectPrimitives, the material table, the BVH build parameters and the
+// path, size and modification time of every file the rest of the scene is loaded from.
+uint64_t hashSceneInput(const Scene& scene, const std::vector<std::string>& inputFiles);
+
+// Cache file for a given input hash inside directory.
+std::string sceneCachePath(const std::string& directory, uint64_t key);
+
+// Maps the cache at path and points the scene's pools and BVHs at it; nothing is
+// copied or parsed. Returns false if the file is missing, was written for another
+// key or version, or its materials differ from the scene's table.
+bool loadSceneCache(const std::string& path, uint64_t key, Scene& scene);
+
+// Writes the pools, materials and BVH nodes of a built scene. Creates the directory
+// if needed and replaces the file atomically.
+bool writeSceneCache(const std::string& path, uint64_t key, const Scene& scene);
+
+#endif // SCENECACHE_H
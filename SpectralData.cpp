@@ -5,142 +5,110 @@
 // SpectralData.cpp
 #include "SpectralData.h"
 #include <algorithm>
+#include <cstring>
 
-Spectrum::Spectrum() {
-    samples.fill(0.0f);
+namespace {
+
+using Table = std::array<float, SPECTRAL_SAMPLES>;
+
+constexpr float constAbs(float x) { return x < 0.0f ? -x : x; }
+
+constexpr float binWavelength(int i) {
+    return MIN_WAVELENGTH + (MAX_WAVELENGTH - MIN_WAVELENGTH) *
+           (static_cast<float>(i) / (SPECTRAL_SAMPLES - 1));
 }
 
-Spectrum::Spectrum(float value) {
-    samples.fill(value);
+// Builds a table by evaluating fn at the wavelength of every bin.
+template <typename Fn>
+constexpr Table makeTable(Fn fn) {
+    Table table{};
+    for (int i = 0; i < SPECTRAL_SAMPLES; i++)
+        table[i] = fn(binWavelength(i));
+    return table;
 }
 
-// Approximate RGB to spectrum conversion
+// Tent-shaped RGB upsampling basis: each primary peaks at its wavelength and falls to zero
+// at the given half-width. fromRGB is a clamped linear combination of these.
+alignas(spectrum_simd::ALIGNMENT) constexpr Table RED_BASIS = makeTable([](float w) {
+    return std::max(0.0f, 1.0f - constAbs((w - 650.0f) / 100.0f));
+});
+alignas(spectrum_simd::ALIGNMENT) constexpr Table GREEN_BASIS = makeTable([](float w) {
+    return std::max(0.0f, 1.0f - constAbs((w - 550.0f) / 80.0f));
+});
+alignas(spectrum_simd::ALIGNMENT) constexpr Table BLUE_BASIS = makeTable([](float w) {
+    return std::max(0.0f, 1.0f - constAbs((w - 450.0f) / 80.0f));
+});
+
+// Simplified versions of the CIE standard observer functions, already scaled by the
+// 3 / SPECTRAL_SAMPLES normalization, so toRGB is one dot product per channel.
+constexpr float RESPONSE_SCALE = 3.0f / SPECTRAL_SAMPLES;
+
+alignas(spectrum_simd::ALIGNMENT) constexpr Table RED_RESPONSE = makeTable([](float w) {
+    // R curve peaks around 650nm
+    return w >= 580.0f ? (1.0f - constAbs((w - 650.0f) / 75.0f)) * RESPONSE_SCALE : 0.0f;
+});
+alignas(spectrum_simd::ALIGNMENT) constexpr Table GREEN_RESPONSE = makeTable([](float w) {
+    // G curve peaks around 550nm
+    return w >= 490.0f && w <= 620.0f ? (1.0f - constAbs((w - 550.0f) / 70.0f)) * RESPONSE_SCALE : 0.0f;
+});
+alignas(spectrum_simd::ALIGNMENT) constexpr Table BLUE_RESPONSE = makeTable([](float w) {
+    // B curve peaks around 450nm
+    return w <= 490.0f ? (1.0f - constAbs((w - 450.0f) / 70.0f)) * RESPONSE_SCALE : 0.0f;
+});
+
+} // namespace
+
+// Approximate RGB to spectrum conversion. Negative components are ignored and each
+// sample is clamped to 1 to prevent over-bright samples.
 Spectrum Spectrum::fromRGB(const glm::vec3& rgb) {
-    Spectrum result;
+    using namespace spectrum_simd;
+    const Lane r = set1(std::max(0.0f, rgb.r));
+    const Lane g = set1(std::max(0.0f, rgb.g));
+    const Lane b = set1(std::max(0.0f, rgb.b));
+    const Lane one = set1(1.0f);
 
-    // More accurate RGB to spectral conversion
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        float wavelength = MIN_WAVELENGTH + (MAX_WAVELENGTH - MIN_WAVELENGTH) *
-                          (static_cast<float>(i) / (SPECTRAL_SAMPLES - 1));
-
-        // Initialize sample to zero
-        result.samples[i] = 0.0f;
-
-        // Red component contribution (peaks around 650nm)
-        if (rgb.r > 0.0f) {
-            float redResponse = std::max(0.0f, 1.0f - std::abs((wavelength - 650.0f) / 100.0f));
-            result.samples[i] += rgb.r * redResponse;
-        }
-
-        // Green component contribution (peaks around 550nm)
-        if (rgb.g > 0.0f) {
-            float greenResponse = std::max(0.0f, 1.0f - std::abs((wavelength - 550.0f) / 80.0f));
-            result.samples[i] += rgb.g * greenResponse;
-        }
-
-        // Blue component contribution (peaks around 450nm)
-        if (rgb.b > 0.0f) {
-            float blueResponse = std::max(0.0f, 1.0f - std::abs((wavelength - 450.0f) / 80.0f));
-            result.samples[i] += rgb.b * blueResponse;
-        }
-
-        // Normalize to prevent over-bright samples
-        result.samples[i] = std::min(1.0f, result.samples[i]);
+    Spectrum result;
+    for (int i = 0; i < SPECTRAL_SAMPLES; i += LANE_WIDTH) {
+        Lane value = mul(r, load(&RED_BASIS[i]));
+        value = fmadd(g, load(&GREEN_BASIS[i]), value);
+        value = fmadd(b, load(&BLUE_BASIS[i]), value);
+        store(&result.samples[i], min(value, one));
     }
-
     return result;
 }
 
 // Convert spectrum to RGB for display
 glm::vec3 Spectrum::toRGB() const {
-    // More accurate conversion using proper color matching functions
-    // These are simplified versions of the CIE standard observer functions
-    float r = 0.0f, g = 0.0f, b = 0.0f;
-
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        float wavelength = MIN_WAVELENGTH + (MAX_WAVELENGTH - MIN_WAVELENGTH) *
-                         (static_cast<float>(i) / (SPECTRAL_SAMPLES - 1));
-        float value = samples[i];
-
-        // Better approximation of RGB response curves
-        // R curve peaks around 650nm
-        if (wavelength >= 580.0f)
-            r += value * (1.0f - std::abs((wavelength - 650.0f) / 75.0f));
-
-        // G curve peaks around 550nm
-        if (wavelength >= 490.0f && wavelength <= 620.0f)
-            g += value * (1.0f - std::abs((wavelength - 550.0f) / 70.0f));
-
-        // B curve peaks around 450nm
-        if (wavelength <= 490.0f)
-            b += value * (1.0f - std::abs((wavelength - 450.0f) / 70.0f));
+    using namespace spectrum_simd;
+    Lane r = set1(0.0f), g = set1(0.0f), b = set1(0.0f);
+    for (int i = 0; i < SPECTRAL_SAMPLES; i += LANE_WIDTH) {
+        const Lane value = load(&samples[i]);
+        r = fmadd(value, load(&RED_RESPONSE[i]), r);
+        g = fmadd(value, load(&GREEN_RESPONSE[i]), g);
+        b = fmadd(value, load(&BLUE_RESPONSE[i]), b);
     }
 
-    // Normalize
     return glm::vec3(
-        std::min(1.0f, r * 3.0f / SPECTRAL_SAMPLES),
-        std::min(1.0f, g * 3.0f / SPECTRAL_SAMPLES),
-        std::min(1.0f, b * 3.0f / SPECTRAL_SAMPLES)
+        std::min(1.0f, reduceAdd(r)),
+        std::min(1.0f, reduceAdd(g)),
+        std::min(1.0f, reduceAdd(b))
     );
 }
 
-Spectrum Spectrum::operator+(const Spectrum& other) const {
-    Spectrum result;
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        result.samples[i] = samples[i] + other.samples[i];
-    }
-    return result;
-}
-
-Spectrum Spectrum::operator*(const Spectrum& other) const {
-    Spectrum result;
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        result.samples[i] = samples[i] * other.samples[i];
-    }
-    return result;
-}
-
-Spectrum Spectrum::operator*(float scalar) const {
-    Spectrum result;
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        result.samples[i] = samples[i] * scalar;
-    }
-    return result;
-}
-
-Spectrum& Spectrum::operator+=(const Spectrum& other) {
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        samples[i] += other.samples[i];
-    }
-    return *this;
+const Spectrum& RGBSpectrumCache::get(const glm::vec3& rgb) {
+    std::array<uint32_t, 3> key;
+    std::memcpy(&key[0], &rgb.r, sizeof(float));
+    std::memcpy(&key[1], &rgb.g, sizeof(float));
+    std::memcpy(&key[2], &rgb.b, sizeof(float));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = spectra.find(key);
+    if (it == spectra.end())
+        it = spectra.emplace(key, Spectrum::fromRGB(rgb)).first;
+    return it->second;
 }
 
-Spectrum& Spectrum::operator*=(float scalar) {
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        samples[i] *= scalar;
-    }
-    return *this;
-}
-
-Spectrum Spectrum::operator/(float scalar) const {
-    Spectrum result;
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        result.samples[i] = samples[i] / scalar;
-    }
-    return result;
-}
-
-Spectrum& Spectrum::operator/=(float scalar) {
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        samples[i] /= scalar;
-    }
-    return *this;
-}
-
-bool Spectrum::operator>(float scalar) const {
-    for (int i = 0; i < SPECTRAL_SAMPLES; i++) {
-        if (samples[i] > scalar)
-            return true;
-    }
-    return false;
+size_t RGBSpectrumCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return spectra.size();
 }
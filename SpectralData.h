@@ -6,9 +6,16 @@
 #define SPECTRALDATA_H
 
 #include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <glm/glm.hpp>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
 // Number of wavelength samples
 constexpr int SPECTRAL_SAMPLES = 32;
 
@@ -16,13 +23,157 @@ constexpr int SPECTRAL_SAMPLES = 32;
 constexpr float MIN_WAVELENGTH = 380.0f;
 constexpr float MAX_WAVELENGTH = 780.0f;
 
-// Spectrum class for wavelength-based color representation
-class Spectrum {
+// Register-wide operations the Spectrum arithmetic is written in. Each lane type covers
+// LANE_WIDTH consecutive samples; SPECTRAL_SAMPLES is a multiple of every width.
+namespace spectrum_simd {
+
+#if defined(__AVX512F__)
+using Lane = __m512;
+constexpr int LANE_WIDTH = 16;
+inline Lane load(const float* p) { return _mm512_load_ps(p); }
+inline void store(float* p, Lane v) { _mm512_store_ps(p, v); }
+inline Lane set1(float v) { return _mm512_set1_ps(v); }
+inline Lane add(Lane a, Lane b) { return _mm512_add_ps(a, b); }
+inline Lane mul(Lane a, Lane b) { return _mm512_mul_ps(a, b); }
+inline Lane max(Lane a, Lane b) { return _mm512_max_ps(a, b); }
+inline Lane min(Lane a, Lane b) { return _mm512_min_ps(a, b); }
+inline Lane fmadd(Lane a, Lane b, Lane c) { return _mm512_fmadd_ps(a, b, c); }
+inline float reduceMax(Lane v) { return _mm512_reduce_max_ps(v); }
+inline float reduceAdd(Lane v) { return _mm512_reduce_add_ps(v); }
+#elif defined(__AVX__)
+using Lane = __m256;
+constexpr int LANE_WIDTH = 8;
+inline Lane load(const float* p) { return _mm256_load_ps(p); }
+inline void store(float* p, Lane v) { _mm256_store_ps(p, v); }
+inline Lane set1(float v) { return _mm256_set1_ps(v); }
+inline Lane add(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+inline Lane mul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+inline Lane max(Lane a, Lane b) { return _mm256_max_ps(a, b); }
+inline Lane min(Lane a, Lane b) { return _mm256_min_ps(a, b); }
+#if defined(__FMA__)
+inline Lane fmadd(Lane a, Lane b, Lane c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+inline Lane fmadd(Lane a, Lane b, Lane c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+inline float reduceMax(Lane v) {
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+inline float reduceAdd(Lane v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#else
+using Lane = float;
+constexpr int LANE_WIDTH = 1;
+inline Lane load(const float* p) { return *p; }
+inline void store(float* p, Lane v) { *p = v; }
+inline Lane set1(float v) { return v; }
+inline Lane add(Lane a, Lane b) { return a + b; }
+inline Lane mul(Lane a, Lane b) { return a * b; }
+inline Lane max(Lane a, Lane b) { return a > b ? a : b; }
+inline Lane min(Lane a, Lane b) { return a < b ? a : b; }
+inline Lane fmadd(Lane a, Lane b, Lane c) { return a * b + c; }
+inline float reduceMax(Lane v) { return v; }
+inline float reduceAdd(Lane v) { return v; }
+#endif
+
+// Aligned to a full lane so every load and store is an aligned one.
+constexpr int ALIGNMENT = LANE_WIDTH * sizeof(float) < 32 ? 32 : LANE_WIDTH * sizeof(float);
+
+static_assert(SPECTRAL_SAMPLES % LANE_WIDTH == 0, "Spectrum must split evenly into SIMD lanes");
+
+} // namespace spectrum_simd
+
+// Number of wavelengths a path carries in hero-wavelength mode.
+constexpr int HERO_WAVELENGTHS = 4;
+
+// Spectrum bins a hero-wavelength path is evaluated at: a uniformly chosen hero bin
+// and the bins spaced evenly after it, wrapping around the visible range. Every bin
+// is picked with probability HERO_WAVELENGTHS / SPECTRAL_SAMPLES.
+struct SampledWavelengths {
+    std::array<int, HERO_WAVELENGTHS> bins;
+
+    static SampledWavelengths sampleStratified(float u) {
+        int hero = static_cast<int>(u * SPECTRAL_SAMPLES);
+        hero = hero < SPECTRAL_SAMPLES ? hero : SPECTRAL_SAMPLES - 1;
+        SampledWavelengths wavelengths;
+        for (int k = 0; k < HERO_WAVELENGTHS; k++)
+            wavelengths.bins[k] = (hero + k * (SPECTRAL_SAMPLES / HERO_WAVELENGTHS)) % SPECTRAL_SAMPLES;
+        return wavelengths;
+    }
+};
+
+// Radiance or reflectance at the HERO_WAVELENGTHS bins of a SampledWavelengths.
+// Offers the same arithmetic as Spectrum so the integrator can run on either.
+class alignas(16) SampledSpectrum {
+public:
+    std::array<float, HERO_WAVELENGTHS> values;
+
+    SampledSpectrum() : SampledSpectrum(0.0f) {}
+    explicit SampledSpectrum(float value) { values.fill(value); }
+
+    SampledSpectrum operator*(float scalar) const { SampledSpectrum r = *this; return r *= scalar; }
+
+    SampledSpectrum& operator+=(const SampledSpectrum& other) {
+        for (int i = 0; i < HERO_WAVELENGTHS; i++) values[i] += other.values[i];
+        return *this;
+    }
+
+    SampledSpectrum& operator*=(const SampledSpectrum& other) {
+        for (int i = 0; i < HERO_WAVELENGTHS; i++) values[i] *= other.values[i];
+        return *this;
+    }
+
+    SampledSpectrum& operator*=(float scalar) {
+        for (int i = 0; i < HERO_WAVELENGTHS; i++) values[i] *= scalar;
+        return *this;
+    }
+
+    SampledSpectrum& operator/=(float scalar) { return *this *= 1.0f / scalar; }
+
+    // this += a * b * scale
+    SampledSpectrum& addProduct(const SampledSpectrum& a, const SampledSpectrum& b, float scale = 1.0f) {
+        for (int i = 0; i < HERO_WAVELENGTHS; i++) values[i] += a.values[i] * b.values[i] * scale;
+        return *this;
+    }
+
+    // this += a * scale
+    SampledSpectrum& addScaled(const SampledSpectrum& a, float scale) {
+        for (int i = 0; i < HERO_WAVELENGTHS; i++) values[i] += a.values[i] * scale;
+        return *this;
+    }
+
+    // this *= a * scale
+    SampledSpectrum& mulScaled(const SampledSpectrum& a, float scale) {
+        for (int i = 0; i < HERO_WAVELENGTHS; i++) values[i] *= a.values[i] * scale;
+        return *this;
+    }
+
+    float maxValue() const {
+        float m = values[0];
+        for (int i = 1; i < HERO_WAVELENGTHS; i++) m = values[i] > m ? values[i] : m;
+        return m;
+    }
+};
+
+// Spectrum class for wavelength-based color representation.
+// Arithmetic runs over whole SIMD lanes. The fused forms (addProduct, addScaled,
+// mulScaled) do a multiply-add in a single pass without building temporaries.
+class alignas(spectrum_simd::ALIGNMENT) Spectrum {
 public:
-    std::array<float, SPECTRAL_SAMPLES> samples;
+    alignas(spectrum_simd::ALIGNMENT) std::array<float, SPECTRAL_SAMPLES> samples;
+
+    Spectrum() : Spectrum(0.0f) {}
 
-    Spectrum();
-    explicit Spectrum(float value); // Uniform spectrum
+    // Uniform spectrum
+    explicit Spectrum(float value) {
+        forEachLane([&](int i) { spectrum_simd::store(&samples[i], spectrum_simd::set1(value)); });
+    }
 
     // Convert RGB to spectrum (approximate)
     static Spectrum fromRGB(const glm::vec3& rgb);
@@ -31,14 +182,114 @@ public:
     glm::vec3 toRGB() const;
 
     // Spectrum operations
-    Spectrum operator+(const Spectrum& other) const;
-    Spectrum operator*(const Spectrum& other) const;
-    Spectrum operator*(float scalar) const;
-    Spectrum& operator+=(const Spectrum& other);
-    Spectrum& operator*=(float scalar);
-    Spectrum operator/(float scalar) const;
-    Spectrum& operator/=(float scalar);
-    bool operator>(float scalar) const;
+    Spectrum operator+(const Spectrum& other) const { Spectrum r = *this; return r += other; }
+    Spectrum operator*(const Spectrum& other) const { Spectrum r = *this; return r *= other; }
+    Spectrum operator*(float scalar) const { Spectrum r = *this; return r *= scalar; }
+    Spectrum operator/(float scalar) const { Spectrum r = *this; return r /= scalar; }
+
+    Spectrum& operator+=(const Spectrum& other) {
+        using namespace spectrum_simd;
+        forEachLane([&](int i) { store(&samples[i], add(load(&samples[i]), load(&other.samples[i]))); });
+        return *this;
+    }
+
+    Spectrum& operator*=(const Spectrum& other) {
+        using namespace spectrum_simd;
+        forEachLane([&](int i) { store(&samples[i], mul(load(&samples[i]), load(&other.samples[i]))); });
+        return *this;
+    }
+
+    Spectrum& operator*=(float scalar) {
+        using namespace spectrum_simd;
+        const Lane s = set1(scalar);
+        forEachLane([&](int i) { store(&samples[i], mul(load(&samples[i]), s)); });
+        return *this;
+    }
+
+    Spectrum& operator/=(float scalar) { return *this *= 1.0f / scalar; }
+
+    bool operator>(float scalar) const { return maxValue() > scalar; }
+
+    // this += a * b * scale
+    Spectrum& addProduct(const Spectrum& a, const Spectrum& b, float scale = 1.0f) {
+        using namespace spectrum_simd;
+        const Lane s = set1(scale);
+        forEachLane([&](int i) {
+            store(&samples[i], fmadd(mul(load(&a.samples[i]), load(&b.samples[i])), s, load(&samples[i])));
+        });
+        return *this;
+    }
+
+    // this += a * scale
+    Spectrum& addScaled(const Spectrum& a, float scale) {
+        using namespace spectrum_simd;
+        const Lane s = set1(scale);
+        forEachLane([&](int i) { store(&samples[i], fmadd(load(&a.samples[i]), s, load(&samples[i]))); });
+        return *this;
+    }
+
+    // this *= a * scale
+    Spectrum& mulScaled(const Spectrum& a, float scale) {
+        using namespace spectrum_simd;
+        const Lane s = set1(scale);
+        forEachLane([&](int i) { store(&samples[i], mul(load(&samples[i]), mul(load(&a.samples[i]), s))); });
+        return *this;
+    }
+
+    // Values at the bins of a hero-wavelength sample.
+    SampledSpectrum sample(const SampledWavelengths& wavelengths) const {
+        SampledSpectrum result;
+        for (int k = 0; k < HERO_WAVELENGTHS; k++)
+            result.values[k] = samples[wavelengths.bins[k]];
+        return result;
+    }
+
+    // Adds a hero-wavelength estimate, times scale, back into its bins.
+    void splat(const SampledWavelengths& wavelengths, const SampledSpectrum& value, float scale) {
+        for (int k = 0; k < HERO_WAVELENGTHS; k++)
+            samples[wavelengths.bins[k]] += value.values[k] * scale;
+    }
+
+    // Largest sample value.
+    float maxValue() const {
+        using namespace spectrum_simd;
+        Lane m = load(&samples[0]);
+        for (int i = LANE_WIDTH; i < SPECTRAL_SAMPLES; i += LANE_WIDTH)
+            m = max(m, load(&samples[i]));
+        return reduceMax(m);
+    }
+
+private:
+    // Calls fn with the first sample index of every lane. The trip count is a
+    // constant, so the loop unrolls into straight-line SIMD code.
+    template <typename Fn>
+    static void forEachLane(Fn&& fn) {
+        for (int i = 0; i < SPECTRAL_SAMPLES; i += spectrum_simd::LANE_WIDTH)
+            fn(i);
+    }
+};
+
+// Memoizes Spectrum::fromRGB. Scene loading converts each distinct colour once and
+// materials with the same colour share the result. Safe to use from several threads.
+class RGBSpectrumCache {
+public:
+    // The returned reference stays valid for the lifetime of the cache.
+    const Spectrum& get(const glm::vec3& rgb);
+
+    size_t size() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const std::array<uint32_t, 3>& key) const {
+            uint64_t h = key[0];
+            h = h * 0x9E3779B97F4A7C15ull ^ key[1];
+            h = h * 0x9E3779B97F4A7C15ull ^ key[2];
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::array<uint32_t, 3>, Spectrum, KeyHash> spectra;
 };
 
-#endif // SPECTRALDATA_H
\ No newline at end of file
+#endif // SPECTRALDATA_H
@@ -4,34 +4,26 @@
 
 // Sphere.cpp
 #include "Entity.h"
+#include "Primitives.h"
 #include <cmath>
 
 bool Sphere::intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
-    // Existing implementation is fine
-    glm::vec3 oc = origin - center;
-    // In Sphere.cpp
-    float a = glm::dot(dir, dir);  // Should be 1.0 if dir is normalized
-    float b = 2.0f * glm::dot(oc, dir);
-    float c = glm::dot(oc, oc) - radius * radius;
-    float discriminant = b * b - 4.0f * a * c;
-    if (discriminant < 0)
-        return false;
-
-    // Consider both intersection points
-    float sqrtd = std::sqrt(discriminant);
-    float t1 = (-b - sqrtd) / (2.0f * a);
-    float t2 = (-b + sqrtd) / (2.0f * a);
-
-    // Use nearest positive intersection
-    float t = (t1 > 0) ? t1 : t2;
-    if (t <= 0)
+    float t;
+    if (!intersectSphere(origin, dir, center, radius, t))
         return false;
 
     rec.t = t;
     rec.hitPoint = origin + dir * t;
-    rec.normal = glm::normalize(rec.hitPoint - center);
-    rec.color = color;
-    rec.emission = emission;
-    rec.isEmissive = isEmissive();
+    rec.normal = (rec.hitPoint - center) / radius;
+    rec.materialId = materialId;
     return true;
-}
\ No newline at end of file
+}
+
+bool Sphere::occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    float t;
+    return intersectSphere(origin, dir, center, radius, t) && t < tMax;
+}
+
+void Sphere::addToPools(PrimitivePools& pools) const {
+    pools.spheres.add(center, radius, materialId);
+}
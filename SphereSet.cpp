@@ -0,0 +1,59 @@
+//
+// Created by alex on 3/29/25.
+//
+
+// SphereSet.cpp
+#include "Entity.h"
+#include "Primitives.h"
+#include <limits>
+
+bool SphereSet::intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
+    float closest = std::numeric_limits<float>::infinity();
+    size_t hitSphere = 0;
+    for (size_t i = 0; i < sphereCount(); i++) {
+        float t;
+        if (intersectSphere(origin, dir, centers[i], radii[i], t) && t < closest) {
+            closest = t;
+            hitSphere = i;
+        }
+    }
+    if (closest == std::numeric_limits<float>::infinity())
+        return false;
+
+    // Only the closest sphere gets a normal.
+    rec.t = closest;
+    rec.hitPoint = origin + dir * closest;
+    rec.normal = (rec.hitPoint - centers[hitSphere]) / radii[hitSphere];
+    rec.primitiveIndex = static_cast<uint32_t>(hitSphere);
+    rec.materialId = materialId;
+    return true;
+}
+
+bool SphereSet::occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    for (size_t i = 0; i < sphereCount(); i++) {
+        float t;
+        if (intersectSphere(origin, dir, centers[i], radii[i], t) && t < tMax)
+            return true;
+    }
+    return false;
+}
+
+void SphereSet::addToPools(PrimitivePools& pools) const {
+    SpherePool& spheres = pools.spheres;
+    const size_t total = spheres.size() + sphereCount();
+    for (auto* values : { &spheres.cx, &spheres.cy, &spheres.cz, &spheres.radius })
+        values->reserve(total);
+    spheres.materialIndex.reserve(total);
+    spheres.lightIndex.reserve(total);
+    for (size_t i = 0; i < sphereCount(); i++)
+        spheres.add(centers[i], radii[i], materialId);
+}
+
+AABB SphereSet::getBounds() const {
+    AABB bounds;
+    for (size_t i = 0; i < sphereCount(); i++) {
+        bounds.expand(centers[i] - glm::vec3(radii[i]));
+        bounds.expand(centers[i] + glm::vec3(radii[i]));
+    }
+    return bounds;
+}
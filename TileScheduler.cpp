@@ -0,0 +1,77 @@
+//
+// Created by alex on 3/20/25.
+//
+
+// TileScheduler.cpp
+#include "TileScheduler.h"
+#include <algorithm>
+
+namespace {
+
+// Interleaves the bits of x and y.
+uint64_t mortonCode(uint32_t x, uint32_t y) {
+    uint64_t code = 0;
+    for (int bit = 0; bit < 32; bit++) {
+        code |= static_cast<uint64_t>((x >> bit) & 1u) << (2 * bit);
+        code |= static_cast<uint64_t>((y >> bit) & 1u) << (2 * bit + 1);
+    }
+    return code;
+}
+
+} // namespace
+
+TileScheduler::TileScheduler(int width, int height, int tileSize) : width(width), height(height) {
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+
+    std::vector<std::pair<uint64_t, Tile>> ordered;
+    ordered.reserve(static_cast<size_t>(tilesX) * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile tile;
+            tile.x0 = tx * tileSize;
+            tile.y0 = ty * tileSize;
+            tile.x1 = std::min(tile.x0 + tileSize, width);
+            tile.y1 = std::min(tile.y0 + tileSize, height);
+            tile.sampleBudget = 1;
+            ordered.emplace_back(mortonCode(tx, ty), tile);
+        }
+    }
+
+    std::sort(ordered.begin(), ordered.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    tiles.reserve(ordered.size());
+    for (const auto& entry : ordered)
+        tiles.push_back(entry.second);
+}
+
+void TileScheduler::setSampleBudget(int samplesPerPixel) {
+    for (Tile& tile : tiles)
+        tile.sampleBudget = samplesPerPixel;
+}
+
+bool TileScheduler::pop(WorkQueue& queue, uint32_t& tile) {
+    uint64_t range = queue.range.load(std::memory_order_acquire);
+    while (front(range) < back(range)) {
+        if (queue.range.compare_exchange_weak(range, pack(front(range) + 1, back(range)), std::memory_order_acq_rel)) {
+            tile = front(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TileScheduler::steal(WorkQueue& victim, uint32_t& first, uint32_t& last) {
+    uint64_t range = victim.range.load(std::memory_order_acquire);
+    while (front(range) < back(range)) {
+        uint32_t remaining = back(range) - front(range);
+        uint32_t split = back(range) - (remaining + 1) / 2;
+        if (victim.range.compare_exchange_weak(range, pack(front(range), split), std::memory_order_acq_rel)) {
+            first = split;
+            last = back(range);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,105 @@
+//
+// Created by alex on 3/20/25.
+//
+
+// TileScheduler.h
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <omp.h>
+
+// Rectangle of pixels [x0, x1) x [y0, y1) rendered as one unit of work.
+struct Tile {
+    int x0, y0, x1, y1;
+    int sampleBudget;   // Samples per pixel this tile receives in the next pass.
+};
+
+// Splits the image into square tiles visited in Morton order and distributes them over the
+// OpenMP threads with work stealing. Every thread starts on its own contiguous run of tiles,
+// so neighbouring tiles (and the BVH nodes they touch) stay on one core; a thread that runs
+// dry steals half of the remaining run of another thread.
+class TileScheduler {
+public:
+    TileScheduler(int width, int height, int tileSize);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    std::vector<Tile>& getTiles() { return tiles; }
+    const std::vector<Tile>& getTiles() const { return tiles; }
+
+    // Gives every tile the same budget.
+    void setSampleBudget(int samplesPerPixel);
+
+    // Calls renderTile(tile) once for every tile, in parallel.
+    template <typename Fn>
+    void run(Fn&& renderTile);
+
+private:
+    // Remaining tile indices [front, back) of one thread, packed into one word so the owner
+    // popping the front and thieves taking the back agree through a single CAS.
+    struct alignas(64) WorkQueue {
+        std::atomic<uint64_t> range{0};
+    };
+
+    static uint64_t pack(uint32_t front, uint32_t back) { return static_cast<uint64_t>(back) << 32 | front; }
+    static uint32_t front(uint64_t range) { return static_cast<uint32_t>(range); }
+    static uint32_t back(uint64_t range) { return static_cast<uint32_t>(range >> 32); }
+
+    static bool pop(WorkQueue& queue, uint32_t& tile);
+    static bool steal(WorkQueue& victim, uint32_t& first, uint32_t& last);
+
+    int width;
+    int height;
+    std::vector<Tile> tiles;
+};
+
+template <typename Fn>
+void TileScheduler::run(Fn&& renderTile) {
+    std::unique_ptr<WorkQueue[]> queues;
+    const uint32_t tileCount = static_cast<uint32_t>(tiles.size());
+
+    #pragma omp parallel default(none) shared(queues, tileCount, renderTile)
+    {
+        const int threadCount = omp_get_num_threads();
+        const int thread = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            queues.reset(new WorkQueue[threadCount]);
+            for (int t = 0; t < threadCount; t++) {
+                uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(tileCount) * t / threadCount);
+                uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(tileCount) * (t + 1) / threadCount);
+                queues[t].range.store(pack(begin, end), std::memory_order_relaxed);
+            }
+        }
+
+        WorkQueue& own = queues[thread];
+        while (true) {
+            uint32_t index;
+            if (pop(own, index)) {
+                renderTile(tiles[index]);
+                continue;
+            }
+
+            // Own run is empty: look for work in the other threads' runs.
+            bool stole = false;
+            for (int i = 1; i < threadCount && !stole; i++) {
+                uint32_t first, last;
+                if (steal(queues[(thread + i) % threadCount], first, last)) {
+                    own.range.store(pack(first + 1, last), std::memory_order_release);
+                    renderTile(tiles[first]);
+                    stole = true;
+                }
+            }
+            if (!stole)
+                break;
+        }
+    }
+}
+
+#endif // TILESCHEDULER_H
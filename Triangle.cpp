@@ -4,33 +4,16 @@
 
 // Triangle.cpp
 #include "Entity.h"
+#include "Primitives.h"
 #include "SamplingHelpers.h"
 #include <glm/glm.hpp>
 #include <cmath>
 
 bool Triangle::intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
-    // Existing implementation is fine
-    const float EPSILON = 1e-8f;
     glm::vec3 edge1 = v1 - v0;
     glm::vec3 edge2 = v2 - v0;
-    glm::vec3 h = glm::cross(dir, edge2);
-    float a = glm::dot(edge1, h);
-    if (std::abs(a) < EPSILON)
-        return false;  // Ray is parallel to triangle.
-
-    float f = 1.0f / a;
-    glm::vec3 s = origin - v0;
-    float u = f * glm::dot(s, h);
-    if (u < 0.0f || u > 1.0f)
-        return false;
-
-    glm::vec3 q = glm::cross(s, edge1);
-    float v = f * glm::dot(dir, q);
-    if (v < 0.0f || (u + v) > 1.0f)
-        return false;
-
-    float t = f * glm::dot(edge2, q);
-    if (t <= EPSILON)
+    float t;
+    if (!intersectTriangle(origin, dir, v0, edge1, edge2, t))
         return false;
 
     rec.t = t;
@@ -41,16 +24,23 @@ bool Triangle::intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecor
         normal = -normal; // Flip normal if it's facing away from the ray
     }
     rec.normal = normal;
-    rec.color = color;
-    rec.emission = emission;
-    rec.isEmissive = isEmissive();
+    rec.materialId = materialId;
     return true;
 }
 
-void Triangle::sampleLight(const glm::vec3& refPoint, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
+bool Triangle::occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    float t;
+    return intersectTriangle(origin, dir, v0, v1 - v0, v2 - v0, t) && t < tMax;
+}
+
+void Triangle::addToPools(PrimitivePools& pools) const {
+    pools.triangles.add(v0, v1, v2, materialId);
+}
+
+void Triangle::sampleLight(const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
     // Uniformly sample a point on the triangle
-    float r1 = random_float();
-    float r2 = random_float();
+    float r1 = sampler.get1D();
+    float r2 = sampler.get1D();
     if (r1 + r2 > 1.0f) { // Ensure uniformity over the triangle
         r1 = 1.0f - r1;
         r2 = 1.0f - r2;
@@ -63,3 +53,7 @@ void Triangle::sampleLight(const glm::vec3& refPoint, glm::vec3& samplePoint, gl
     pdf = 1.0f / area;
 }
 
+float Triangle::pdfLight(const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const {
+    float area = surfaceArea();
+    return area > 0.0f ? areaToSolidAnglePdf(1.0f / area, refPoint, lightPoint, lightNormal) : 0.0f;
+}
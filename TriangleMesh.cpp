@@ -0,0 +1,171 @@
+//
+// Created by alex on 3/24/25.
+//
+
+// TriangleMesh.cpp
+#include "Entity.h"
+#include "Primitives.h"
+#include "SamplingHelpers.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <limits>
+
+TriangleMesh::TriangleMesh(std::vector<glm::vec3> positions, std::vector<uint32_t> indices, uint32_t materialId,
+                           std::vector<glm::vec3> normals, std::vector<glm::vec2> uvs)
+    : positions(std::move(positions)), indices(std::move(indices)),
+      normals(std::move(normals)), uvs(std::move(uvs)), materialId(materialId) {
+    computeAreas();
+}
+
+void TriangleMesh::computeAreas() {
+    areaCdf.resize(triangleCount());
+    float total = 0.0f;
+    for (size_t i = 0; i < triangleCount(); i++) {
+        total += triangleArea(i);
+        areaCdf[i] = total;
+    }
+}
+
+bool TriangleMesh::intersect(const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
+    float closest = std::numeric_limits<float>::infinity();
+    size_t hitTriangle = 0;
+    for (size_t i = 0; i < triangleCount(); i++) {
+        glm::vec3 v0 = vertex(i, 0);
+        float t;
+        if (intersectTriangle(origin, dir, v0, vertex(i, 1) - v0, vertex(i, 2) - v0, t) && t < closest) {
+            closest = t;
+            hitTriangle = i;
+        }
+    }
+    if (closest == std::numeric_limits<float>::infinity())
+        return false;
+
+    glm::vec3 v0 = vertex(hitTriangle, 0);
+    glm::vec3 edge1 = vertex(hitTriangle, 1) - v0;
+    glm::vec3 edge2 = vertex(hitTriangle, 2) - v0;
+
+    rec.t = closest;
+    rec.hitPoint = origin + dir * closest;
+    rec.primitiveIndex = static_cast<uint32_t>(hitTriangle);
+    rec.materialId = materialId;
+
+    glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
+    if (!normals.empty() || !uvs.empty()) {
+        glm::vec2 b = triangleBarycentrics(rec.hitPoint, v0, edge1, edge2);
+        float b0 = 1.0f - b.x - b.y;
+        uint32_t i0 = indices[hitTriangle * 3];
+        uint32_t i1 = indices[hitTriangle * 3 + 1];
+        uint32_t i2 = indices[hitTriangle * 3 + 2];
+        if (!normals.empty())
+            normal = glm::normalize(normals[i0] * b0 + normals[i1] * b.x + normals[i2] * b.y);
+        if (!uvs.empty())
+            rec.uv = uvs[i0] * b0 + uvs[i1] * b.x + uvs[i2] * b.y;
+    }
+    // Ensure normal faces toward the ray origin
+    if (glm::dot(normal, dir) > 0.0f)
+        normal = -normal;
+    rec.normal = normal;
+    return true;
+}
+
+bool TriangleMesh::occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    for (size_t i = 0; i < triangleCount(); i++) {
+        glm::vec3 v0 = vertex(i, 0);
+        float t;
+        if (intersectTriangle(origin, dir, v0, vertex(i, 1) - v0, vertex(i, 2) - v0, t) && t < tMax)
+            return true;
+    }
+    return false;
+}
+
+void TriangleMesh::addToPools(PrimitivePools& pools) const {
+    uint32_t firstCorner = TrianglePool::NO_ATTRIBUTES;
+    if (!normals.empty() || !uvs.empty()) {
+        VertexAttributes& attributes = pools.attributes;
+        uint32_t base = static_cast<uint32_t>(attributes.normals.size());
+        if (normals.empty())
+            attributes.normals.resize(base + positions.size(), glm::vec3(0.0f));
+        else
+            attributes.normals.append(normals.data(), normals.size());
+        if (uvs.empty())
+            attributes.uvs.resize(base + positions.size(), glm::vec2(0.0f));
+        else
+            attributes.uvs.append(uvs.data(), uvs.size());
+
+        firstCorner = static_cast<uint32_t>(attributes.corners.size());
+        attributes.corners.reserve(attributes.corners.size() + indices.size());
+        for (uint32_t index : indices)
+            attributes.corners.push_back(base + index);
+    }
+
+    for (size_t i = 0; i < triangleCount(); i++) {
+        uint32_t corners = firstCorner == TrianglePool::NO_ATTRIBUTES
+            ? TrianglePool::NO_ATTRIBUTES : firstCorner + static_cast<uint32_t>(i * 3);
+        pools.triangles.add(vertex(i, 0), vertex(i, 1), vertex(i, 2), materialId, corners);
+    }
+}
+
+void TriangleMesh::sampleLight(const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
+    if (areaCdf.empty() || areaCdf.back() <= 0.0f) {
+        pdf = 0.0f;
+        return;
+    }
+    float totalArea = areaCdf.back();
+
+    // Pick a triangle in proportion to its area
+    float target = sampler.get1D() * totalArea;
+    size_t i = std::upper_bound(areaCdf.begin(), areaCdf.end(), target) - areaCdf.begin();
+    i = std::min(i, areaCdf.size() - 1);
+
+    sampleTriangle(i, sampler, samplePoint, lightNormal);
+    pdf = 1.0f / totalArea;
+}
+
+float TriangleMesh::pdfLight(const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const {
+    if (areaCdf.empty() || areaCdf.back() <= 0.0f)
+        return 0.0f;
+    return areaToSolidAnglePdf(1.0f / areaCdf.back(), refPoint, lightPoint, lightNormal);
+}
+
+void TriangleMesh::sampleTriangle(size_t triangle, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal) const {
+    float r1 = sampler.get1D();
+    float r2 = sampler.get1D();
+    if (r1 + r2 > 1.0f) {
+        r1 = 1.0f - r1;
+        r2 = 1.0f - r2;
+    }
+    glm::vec3 v0 = vertex(triangle, 0);
+    glm::vec3 edge1 = vertex(triangle, 1) - v0;
+    glm::vec3 edge2 = vertex(triangle, 2) - v0;
+    samplePoint = v0 + r1 * edge1 + r2 * edge2;
+    lightNormal = glm::normalize(glm::cross(edge1, edge2));
+}
+
+AABB TriangleMesh::partBounds(uint32_t part) const {
+    AABB bounds;
+    for (int corner = 0; corner < 3; corner++)
+        bounds.expand(vertex(part, corner));
+    return bounds;
+}
+
+void TriangleMesh::samplePart(uint32_t part, const glm::vec3& refPoint, Sampler& sampler, glm::vec3& samplePoint, glm::vec3& lightNormal, float& pdf) const {
+    float area = triangleArea(part);
+    if (area <= 0.0f) {
+        pdf = 0.0f;
+        return;
+    }
+    sampleTriangle(part, sampler, samplePoint, lightNormal);
+    pdf = 1.0f / area;
+}
+
+float TriangleMesh::pdfPart(uint32_t part, const glm::vec3& refPoint, const glm::vec3& lightPoint, const glm::vec3& lightNormal) const {
+    float area = triangleArea(part);
+    return area > 0.0f ? areaToSolidAnglePdf(1.0f / area, refPoint, lightPoint, lightNormal) : 0.0f;
+}
+
+AABB TriangleMesh::getBounds() const {
+    AABB bounds;
+    for (size_t i = 0; i < indices.size(); i++)
+        bounds.expand(positions[indices[i]]);
+    return bounds;
+}
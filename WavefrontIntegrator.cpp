@@ -0,0 +1,272 @@
+//
+// Created by alex on 3/29/25.
+//
+
+// WavefrontIntegrator.cpp
+#include "WavefrontIntegrator.h"
+#include "PathIntegrator.h"
+#include "RayPacket.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Spreads the low 10 bits of v so that two zero bits follow each of them.
+uint32_t expandBits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// Sort key of a ray: the octant of its direction, then the Morton code of its origin
+// quantized to 9 bits per axis inside bounds. Rays with equal keys start close together
+// and head the same way, so they walk down mostly the same BVH nodes.
+uint32_t rayKey(const glm::vec3& origin, const glm::vec3& dir, const AABB& bounds) {
+    uint32_t octant = (dir.x < 0.0f ? 1u : 0u) | (dir.y < 0.0f ? 2u : 0u) | (dir.z < 0.0f ? 4u : 0u);
+    glm::vec3 extent = glm::max(bounds.extent(), glm::vec3(1e-6f));
+    glm::vec3 cell = glm::clamp((origin - bounds.min) / extent, 0.0f, 1.0f) * 511.0f;
+    uint32_t morton = expandBits(static_cast<uint32_t>(cell.x)) |
+                      expandBits(static_cast<uint32_t>(cell.y)) << 1 |
+                      expandBits(static_cast<uint32_t>(cell.z)) << 2;
+    return octant << 27 | morton;
+}
+
+bool sameOctant(const glm::vec3& a, const glm::vec3& b) {
+    return (a.x < 0.0f) == (b.x < 0.0f) && (a.y < 0.0f) == (b.y < 0.0f) && (a.z < 0.0f) == (b.z < 0.0f);
+}
+
+// Splits queue, in ray key order, into runs of up to RayBatch::SIZE rays that head into
+// the same octant and calls trace(first, count) for each.
+template <typename DirFn, typename TraceFn>
+void forEachBatch(const std::vector<uint32_t>& queue, DirFn dir, TraceFn trace) {
+    size_t first = 0;
+    while (first < queue.size()) {
+        const glm::vec3 lead = dir(queue[first]);
+        size_t count = 1;
+        while (count < RayBatch::SIZE && first + count < queue.size() && sameOctant(lead, dir(queue[first + count])))
+            count++;
+        trace(first, count);
+        first += count;
+    }
+}
+
+// Next ray of a path, copied out of its PathState so sorting and batching the extension
+// rays reads a few bytes per path instead of the whole state.
+struct QueuedRay {
+    glm::vec3 origin;
+    glm::vec3 dir;
+};
+
+// Queues and per-path state of one thread, kept between tiles so a wave does not start
+// by allocating its buffers.
+template <typename Path>
+struct Workspace {
+    std::vector<PathState<Path>> paths;
+    std::vector<Sampler> samplers;
+    std::vector<HitRecord> hits;
+    std::vector<uint8_t> found;
+    std::vector<QueuedRay> rays;
+    ShadowRay<typename Path::PathSpectrum> shadows[RayBatch::SIZE];   // Of the batch being shaded.
+    std::vector<Spectrum> pixelSpectrum;
+    std::vector<uint32_t> extensionQueue, shadingQueue;
+    std::vector<uint32_t> traceQueue;   // The extension queue in ray key order.
+
+    // Radix sort scratch.
+    std::vector<uint32_t> keys, sortedKeys, sortedQueue;
+};
+
+// Reorders the path indices in queue by key(index) with a stable radix sort, one byte
+// per pass. Passes where every key has the same byte are skipped, which makes sorting
+// by material, with its handful of distinct keys, nearly free.
+template <typename Path, typename KeyFn>
+void sortQueue(std::vector<uint32_t>& queue, Workspace<Path>& workspace, KeyFn key) {
+    const size_t n = queue.size();
+    if (n < 2)
+        return;
+    std::vector<uint32_t>& keys = workspace.keys;
+    std::vector<uint32_t>& sortedKeys = workspace.sortedKeys;
+    std::vector<uint32_t>& sortedQueue = workspace.sortedQueue;
+    keys.resize(n);
+    sortedKeys.resize(n);
+    sortedQueue.resize(n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = key(queue[i]);
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        size_t offsets[257] = {};
+        for (size_t i = 0; i < n; i++)
+            offsets[((keys[i] >> shift) & 0xFFu) + 1]++;
+        if (offsets[((keys[0] >> shift) & 0xFFu) + 1] == n)
+            continue;
+        for (int b = 0; b < 256; b++)
+            offsets[b + 1] += offsets[b];
+        for (size_t i = 0; i < n; i++) {
+            size_t slot = offsets[(keys[i] >> shift) & 0xFFu]++;
+            sortedKeys[slot] = keys[i];
+            sortedQueue[slot] = queue[i];
+        }
+        keys.swap(sortedKeys);
+        queue.swap(sortedQueue);
+    }
+}
+
+template <typename Path>
+void accumulateTiles(Spectrum* accumulation,
+                     uint32_t* sampleCounts,
+                     const Scene& scene,
+                     const Camera& camera,
+                     const RenderSettings& settings,
+                     TileScheduler& scheduler) {
+    const int width = scheduler.getWidth();
+    const int height = scheduler.getHeight();
+    const float scale = settings.imagePlaneScale();
+
+    scheduler.run([&](const Tile& tile) {
+        const int tileWidth = tile.x1 - tile.x0;
+        const int pixelCount = tileWidth * (tile.y1 - tile.y0);
+        const int waveSamples = std::clamp(WavefrontIntegrator::MAX_PATHS / pixelCount, 1, std::max(tile.sampleBudget, 1));
+
+        thread_local Workspace<Path> workspace;
+        auto& pixelSpectrum = workspace.pixelSpectrum;
+        pixelSpectrum.assign(pixelCount, Spectrum(0.0f));
+        auto& paths = workspace.paths;
+        auto& samplers = workspace.samplers;
+        auto& hits = workspace.hits;
+        auto& found = workspace.found;
+        auto& rays = workspace.rays;
+        auto& extensionQueue = workspace.extensionQueue;
+        auto& shadingQueue = workspace.shadingQueue;
+        auto& traceQueue = workspace.traceQueue;
+
+        for (int firstSample = 0; firstSample < tile.sampleBudget; firstSample += waveSamples) {
+            const int samples = std::min(waveSamples, tile.sampleBudget - firstSample);
+
+            // Generation: one path per pixel and sample, pixel-major so path i belongs to
+            // pixel i / samples.
+            paths.clear();
+            samplers.clear();
+            shadingQueue.clear();
+            for (int p = 0; p < pixelCount; p++) {
+                const int x = tile.x0 + p % tileWidth;
+                const int y = tile.y0 + p / tileWidth;
+                const int pixel = y * width + x;
+                for (int k = 0; k < samples; k++) {
+                    // Each sample owns its random sequence, keyed by pixel and sample index.
+                    Sampler& sampler = samplers.emplace_back(pixel, sampleCounts[pixel] + firstSample + k);
+                    PathState<Path>& state = paths.emplace_back();
+                    state.dir = cameraRayDirection(camera, x, y, width, height, scale, sampler);
+                    state.path = Path::sample(sampler);
+                    state.origin = camera.position;
+                    state.bsdfOrigin = camera.position;
+                    shadingQueue.push_back(static_cast<uint32_t>(paths.size() - 1));
+                }
+            }
+            hits.resize(paths.size());
+            found.resize(paths.size());
+            rays.resize(paths.size());
+
+            // Camera rays: consecutive paths are jittered samples of one pixel, coherent
+            // enough to go through the BVH as packets without sorting.
+            for (size_t first = 0; first < paths.size(); first += RayPacket::SIZE) {
+                RayPacket packet;
+                packet.origin = camera.position;
+                const size_t count = std::min<size_t>(RayPacket::SIZE, paths.size() - first);
+                for (size_t c = 0; c < count; c++)
+                    packet.add(paths[first + c].dir);
+                packet.prepare();
+                const uint32_t mask = scene.intersect(packet, &hits[first]);
+                for (size_t c = 0; c < count; c++)
+                    found[first + c] = (mask >> c) & 1u;
+            }
+
+            while (true) {
+                // Shading, in path order so the path state is read front to back, a batch
+                // of paths at a time. Neighbouring paths are samples of one pixel, so their
+                // shadow rays start close together and are traced as a batch right away,
+                // while their state is still in cache. Paths that go on join the extension queue.
+                extensionQueue.clear();
+                for (size_t first = 0; first < shadingQueue.size(); first += RayBatch::SIZE) {
+                    const size_t count = std::min<size_t>(RayBatch::SIZE, shadingQueue.size() - first);
+                    auto& shadows = workspace.shadows;
+                    uint32_t shadowPaths[RayBatch::SIZE];
+                    RayBatch batch;
+                    for (size_t k = 0; k < count; k++) {
+                        const uint32_t i = shadingQueue[first + k];
+                        ShadowRay<typename Path::PathSpectrum>& shadow = shadows[batch.count];
+                        if (shadeVertex(paths[i], found[i] != 0, hits[i], scene, settings, settings.maxDepth,
+                                        samplers[i], shadow)) {
+                            extensionQueue.push_back(i);
+                            rays[i] = { paths[i].origin, paths[i].dir };
+                        }
+                        if (shadow.pending) {
+                            shadowPaths[batch.count] = i;
+                            batch.add(shadow.origin, shadow.dir, shadow.tMax);
+                        }
+                    }
+                    if (batch.count == 0)
+                        continue;
+                    batch.prepare();
+                    const uint32_t blocked = scene.occluded(batch);
+                    for (int k = 0; k < batch.count; k++) {
+                        if (!((blocked >> k) & 1u))
+                            paths[shadowPaths[k]].radiance += shadows[k].contribution;
+                    }
+                }
+
+                if (extensionQueue.empty())
+                    break;
+
+                // Extension: trace the next ray of every live path, in ray key order.
+                AABB origins;
+                for (uint32_t i : extensionQueue)
+                    origins.expand(rays[i].origin);
+                traceQueue = extensionQueue;
+                sortQueue(traceQueue, workspace, [&](uint32_t i) {
+                    return rayKey(rays[i].origin, rays[i].dir, origins);
+                });
+                forEachBatch(traceQueue, [&](uint32_t i) { return rays[i].dir; }, [&](size_t first, size_t count) {
+                    RayBatch batch;
+                    for (size_t k = 0; k < count; k++)
+                        batch.add(rays[traceQueue[first + k]].origin, rays[traceQueue[first + k]].dir);
+                    batch.prepare();
+                    HitRecord batchHits[RayBatch::SIZE];
+                    const uint32_t mask = scene.intersect(batch, batchHits);
+                    for (size_t k = 0; k < count; k++) {
+                        const uint32_t i = traceQueue[first + k];
+                        found[i] = (mask >> k) & 1u;
+                        if (found[i])
+                            hits[i] = batchHits[k];
+                    }
+                });
+                shadingQueue.swap(extensionQueue);
+            }
+
+            // Splat in sample order, so every pixel sums its samples in the same order as
+            // the path-at-a-time integrator.
+            for (size_t i = 0; i < paths.size(); i++)
+                paths[i].path.splat(pixelSpectrum[i / samples], paths[i].radiance);
+        }
+
+        for (int p = 0; p < pixelCount; p++) {
+            const int pixel = (tile.y0 + p / tileWidth) * width + tile.x0 + p % tileWidth;
+            accumulation[pixel] += pixelSpectrum[p];
+            sampleCounts[pixel] += tile.sampleBudget;
+        }
+    });
+}
+
+} // namespace
+
+void WavefrontIntegrator::accumulateSamples(Spectrum* accumulation,
+                                            uint32_t* sampleCounts,
+                                            const Scene& scene,
+                                            const Camera& camera,
+                                            const RenderSettings& settings,
+                                            TileScheduler& scheduler) {
+    if (settings.heroWavelengths)
+        accumulateTiles<HeroWavelengthPath>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+    else
+        accumulateTiles<FullSpectrumPath>(accumulation, sampleCounts, scene, camera, settings, scheduler);
+}
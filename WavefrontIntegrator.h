@@ -0,0 +1,40 @@
+//
+// Created by alex on 3/29/25.
+//
+
+// WavefrontIntegrator.h
+#ifndef WAVEFRONTINTEGRATOR_H
+#define WAVEFRONTINTEGRATOR_H
+
+#include <cstdint>
+
+#include "RenderSettings.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "SpectralData.h"
+#include "TileScheduler.h"
+
+// Path tracer that advances all paths of a tile one bounce at a time instead of following
+// each path to its end. Every bounce goes through queues: hits are shaded in path order,
+// with the shadow rays of each RayBatch::SIZE paths traced together, and the extension
+// rays are sorted by direction octant and origin and traced in batches that share an
+// octant, so each BVH node is tested against several rays at once. Traces the same paths
+// as the path-at-a-time loop.
+// Not selectable from the command line: on the scenes measured so far it is slower than
+// the path-at-a-time loop, which keeps a path's state in L1 between bounces.
+class WavefrontIntegrator {
+public:
+    // Same contract as Renderer::accumulateSamples.
+    static void accumulateSamples(Spectrum* accumulation,
+                                  uint32_t* sampleCounts,
+                                  const Scene& scene,
+                                  const Camera& camera,
+                                  const RenderSettings& settings,
+                                  TileScheduler& scheduler);
+
+    // Upper bound on the paths of one tile kept in flight at once; larger sample budgets
+    // run in several waves.
+    static constexpr int MAX_PATHS = 1024;
+};
+
+#endif // WAVEFRONTINTEGRATOR_H
@@ -0,0 +1,294 @@
+//
+// Created by alex on 3/15/25.
+//
+
+// WideBVH.cpp
+#include "WideBVH.h"
+#include <algorithm>
+#include <limits>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// A wide node is no deeper than the binary node it was collapsed from, and leaves all
+// but one of its hit children on the stack.
+constexpr int STACK_SIZE = BVH::MAX_DEPTH * (WideBVHNode::WIDTH - 1) + 1;
+
+struct StackEntry {
+    uint32_t index;
+    uint16_t count;   // > 0 for leaves
+    uint8_t type;
+    float tNear;
+};
+
+struct WideRay {
+    glm::vec3 origin;
+    glm::vec3 invDir;
+    glm::vec3 originScaled;   // origin * invDir, so each slab is a single multiply-subtract
+};
+
+// Slab-tests every child of the node. Returns a mask of the hit slots and writes their entry distances.
+inline uint32_t intersectChildren(const WideBVHNode& node, const WideRay& ray, float tMax, float* tNear) {
+#if defined(__AVX__)
+    const __m256 ix = _mm256_set1_ps(ray.invDir.x);
+    const __m256 iy = _mm256_set1_ps(ray.invDir.y);
+    const __m256 iz = _mm256_set1_ps(ray.invDir.z);
+    const __m256 ox = _mm256_set1_ps(ray.originScaled.x);
+    const __m256 oy = _mm256_set1_ps(ray.originScaled.y);
+    const __m256 oz = _mm256_set1_ps(ray.originScaled.z);
+
+#if defined(__FMA__)
+    __m256 tx0 = _mm256_fmsub_ps(_mm256_load_ps(node.minX), ix, ox);
+    __m256 tx1 = _mm256_fmsub_ps(_mm256_load_ps(node.maxX), ix, ox);
+    __m256 ty0 = _mm256_fmsub_ps(_mm256_load_ps(node.minY), iy, oy);
+    __m256 ty1 = _mm256_fmsub_ps(_mm256_load_ps(node.maxY), iy, oy);
+    __m256 tz0 = _mm256_fmsub_ps(_mm256_load_ps(node.minZ), iz, oz);
+    __m256 tz1 = _mm256_fmsub_ps(_mm256_load_ps(node.maxZ), iz, oz);
+#else
+    __m256 tx0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(node.minX), ix), ox);
+    __m256 tx1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(node.maxX), ix), ox);
+    __m256 ty0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(node.minY), iy), oy);
+    __m256 ty1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(node.maxY), iy), oy);
+    __m256 tz0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(node.minZ), iz), oz);
+    __m256 tz1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(node.maxZ), iz), oz);
+#endif
+
+    __m256 nearT = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)),
+                                 _mm256_max_ps(_mm256_min_ps(tz0, tz1), _mm256_setzero_ps()));
+    __m256 farT = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)),
+                                _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_set1_ps(tMax)));
+
+    _mm256_storeu_ps(tNear, nearT);
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(nearT, farT, _CMP_LE_OQ)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < WideBVHNode::WIDTH; i++) {
+        AABB box(glm::vec3(node.minX[i], node.minY[i], node.minZ[i]),
+                 glm::vec3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+        if (box.intersect(ray.origin, ray.invDir, 0.0f, tMax, tNear[i]))
+            mask |= 1u << i;
+    }
+#endif
+    return mask & ((1u << node.childCount) - 1u);
+}
+
+} // namespace
+
+void WideBVHNode::setChild(int slot, const AABB& bounds, uint32_t childIndex, uint16_t primCount, uint8_t primType) {
+    setBounds(slot, bounds);
+    child[slot] = childIndex;
+    count[slot] = primCount;
+    type[slot] = primType;
+}
+
+void WideBVHNode::setBounds(int slot, const AABB& bounds) {
+    minX[slot] = bounds.min.x;
+    minY[slot] = bounds.min.y;
+    minZ[slot] = bounds.min.z;
+    maxX[slot] = bounds.max.x;
+    maxY[slot] = bounds.max.y;
+    maxZ[slot] = bounds.max.z;
+}
+
+WideBVH::WideBVH(const BVH& bvh) {
+    if (bvh.nodes.empty())
+        return;
+
+    std::vector<WideBVHNode> built;
+    built.reserve(bvh.nodes.size() / 4 + 1);
+    binarySlots.assign(bvh.nodes.size(), NO_SLOT);
+    const BVHNode& root = bvh.nodes[0];
+    if (root.isLeaf()) {
+        built.emplace_back();
+        built[0].setChild(0, root.bounds, root.offset, root.count, root.type);
+        built[0].childCount = 1;
+        binarySlots[0] = 0;
+    } else {
+        collapse(bvh, 0, built);
+    }
+    nodes = Buffer<WideBVHNode>(std::move(built));
+}
+
+// Pulls up to WIDTH descendants of a binary interior node into one wide node,
+// always opening the child with the largest surface area first.
+uint32_t WideBVH::collapse(const BVH& bvh, uint32_t binaryIndex, std::vector<WideBVHNode>& built) {
+    uint32_t slots[WideBVHNode::WIDTH];
+    int slotCount = 0;
+    slots[slotCount++] = binaryIndex + 1;
+    slots[slotCount++] = bvh.nodes[binaryIndex].offset;
+
+    while (slotCount < WideBVHNode::WIDTH) {
+        int best = -1;
+        float bestArea = -1.0f;
+        for (int i = 0; i < slotCount; i++) {
+            const BVHNode& node = bvh.nodes[slots[i]];
+            if (!node.isLeaf() && node.bounds.surfaceArea() > bestArea) {
+                bestArea = node.bounds.surfaceArea();
+                best = i;
+            }
+        }
+        if (best < 0)
+            break;
+
+        uint32_t opened = slots[best];
+        slots[best] = opened + 1;
+        slots[slotCount++] = bvh.nodes[opened].offset;
+    }
+
+    uint32_t index = static_cast<uint32_t>(built.size());
+    built.emplace_back();
+    built[index].childCount = static_cast<uint8_t>(slotCount);
+
+    for (int i = 0; i < slotCount; i++) {
+        const BVHNode& node = bvh.nodes[slots[i]];
+        if (node.isLeaf()) {
+            built[index].setChild(i, node.bounds, node.offset, node.count, node.type);
+        } else {
+            uint32_t childIndex = collapse(bvh, slots[i], built);
+            built[index].setChild(i, node.bounds, childIndex, 0);
+        }
+        binarySlots[slots[i]] = index * WideBVHNode::WIDTH + i;
+    }
+    return index;
+}
+
+void WideBVH::refit(const BVH& bvh, const std::vector<uint32_t>& refitted) {
+    std::vector<WideBVHNode>& built = nodes.values();
+    #pragma omp parallel for if (refitted.size() >= BVH::REFIT_PARALLEL_THRESHOLD)
+    for (size_t k = 0; k < refitted.size(); k++) {
+        uint32_t slot = binarySlots[refitted[k]];
+        if (slot != NO_SLOT)
+            built[slot / WideBVHNode::WIDTH].setBounds(slot % WideBVHNode::WIDTH, bvh.nodes[refitted[k]].bounds);
+    }
+}
+
+bool WideBVH::isSubtreeRoot(uint32_t binaryNode) const {
+    if (binaryNode == 0)
+        return true;
+    if (binaryNode >= binarySlots.size() || binarySlots[binaryNode] == NO_SLOT)
+        return false;
+    uint32_t slot = binarySlots[binaryNode];
+    return nodes[slot / WideBVHNode::WIDTH].count[slot % WideBVHNode::WIDTH] == 0;
+}
+
+void WideBVH::replaceSubtree(const BVH& bvh, uint32_t binaryRoot) {
+    // Indices below binaryRoot may have been reused by the rebuild; forget their old slots.
+    binarySlots.resize(bvh.nodes.size(), NO_SLOT);
+    std::vector<uint32_t> stack = { binaryRoot };
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        const BVHNode& node = bvh.nodes[index];
+        if (index != binaryRoot)
+            binarySlots[index] = NO_SLOT;
+        if (!node.isLeaf()) {
+            stack.push_back(index + 1);
+            stack.push_back(node.offset);
+        }
+    }
+
+    const uint32_t slot = binarySlots[binaryRoot];
+    const BVHNode& root = bvh.nodes[binaryRoot];
+    std::vector<WideBVHNode>& built = nodes.values();
+    WideBVHNode parent = built[slot / WideBVHNode::WIDTH];
+    if (root.isLeaf())
+        parent.setChild(slot % WideBVHNode::WIDTH, root.bounds, root.offset, root.count, root.type);
+    else
+        parent.setChild(slot % WideBVHNode::WIDTH, root.bounds, collapse(bvh, binaryRoot, built), 0);
+    built[slot / WideBVHNode::WIDTH] = parent;
+    nodes.sync();
+}
+
+bool WideBVH::intersect(const PrimitivePools& primitives,
+                        const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const {
+    if (nodes.empty())
+        return false;
+
+    WideRay ray;
+    ray.origin = origin;
+    ray.invDir = 1.0f / dir;
+    ray.originScaled = origin * ray.invDir;
+
+    PrimitiveHit hit;
+
+    StackEntry stack[STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, 0, 0, 0.0f };
+
+    while (stackSize > 0) {
+        StackEntry entry = stack[--stackSize];
+        if (entry.tNear > hit.t)
+            continue;
+
+        if (entry.count > 0) {
+            primitives.intersect(static_cast<PrimitiveType>(entry.type), entry.index, entry.count, origin, dir, hit);
+            continue;
+        }
+
+        const WideBVHNode& node = nodes[entry.index];
+        alignas(32) float tNear[WideBVHNode::WIDTH];
+        uint32_t mask = intersectChildren(node, ray, hit.t, tNear);
+
+        // Sort the hit children far-to-near so the nearest one ends up on top of the stack.
+        StackEntry hits[WideBVHNode::WIDTH];
+        int hitCount = 0;
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            StackEntry child = { node.child[slot], node.count[slot], node.type[slot], tNear[slot] };
+            int j = hitCount++;
+            while (j > 0 && hits[j - 1].tNear < child.tNear) {
+                hits[j] = hits[j - 1];
+                j--;
+            }
+            hits[j] = child;
+        }
+        for (int i = 0; i < hitCount; i++)
+            stack[stackSize++] = hits[i];
+    }
+
+    if (hit.t == std::numeric_limits<float>::infinity())
+        return false;
+    primitives.fillHitRecord(hit, origin, dir, rec);
+    return true;
+}
+
+bool WideBVH::occluded(const PrimitivePools& primitives,
+                       const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    if (nodes.empty())
+        return false;
+
+    WideRay ray;
+    ray.origin = origin;
+    ray.invDir = 1.0f / dir;
+    ray.originScaled = origin * ray.invDir;
+
+    StackEntry stack[STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, 0, 0, 0.0f };
+
+    // No sorting here: any blocker ends the query, so children are pushed in slot order.
+    while (stackSize > 0) {
+        StackEntry entry = stack[--stackSize];
+
+        if (entry.count > 0) {
+            if (primitives.occluded(static_cast<PrimitiveType>(entry.type), entry.index, entry.count,
+                                    origin, dir, tMax))
+                return true;
+            continue;
+        }
+
+        const WideBVHNode& node = nodes[entry.index];
+        alignas(32) float tNear[WideBVHNode::WIDTH];
+        uint32_t mask = intersectChildren(node, ray, tMax, tNear);
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            stack[stackSize++] = { node.child[slot], node.count[slot], node.type[slot], tNear[slot] };
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,68 @@
+//
+// Created by alex on 3/15/25.
+//
+
+// WideBVH.h
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include "BVH.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 8-wide node with child bounds in SoA form so all children are slab-tested at once.
+// Leaves are stored inline in their parent's child slots.
+struct alignas(64) WideBVHNode {
+    static constexpr int WIDTH = 8;
+
+    float minX[WIDTH] = {}, minY[WIDTH] = {}, minZ[WIDTH] = {};
+    float maxX[WIDTH] = {}, maxY[WIDTH] = {}, maxZ[WIDTH] = {};
+    uint32_t child[WIDTH] = {};   // Interior slot: wide node index. Leaf slot: first primitive in its pool.
+    uint16_t count[WIDTH] = {};   // Number of primitives for leaf slots, 0 for interior slots.
+    uint8_t type[WIDTH] = {};     // PrimitiveType of leaf slots.
+    uint8_t childCount = 0;       // Slots [0, childCount) are in use.
+
+    void setChild(int slot, const AABB& bounds, uint32_t child, uint16_t count, uint8_t type = 0);
+    void setBounds(int slot, const AABB& bounds);
+};
+
+// BVH8 collapsed from a binary BVH. Traversal tests all children of a node with one
+// AVX slab test and visits the hit children in near-to-far order.
+class WideBVH {
+public:
+    Buffer<WideBVHNode> nodes;
+
+    explicit WideBVH(const BVH& bvh);
+
+    // Empty BVH, for nodes that are filled in from a scene cache.
+    WideBVH() = default;
+
+    bool intersect(const PrimitivePools& primitives,
+                   const glm::vec3& origin, const glm::vec3& dir, HitRecord& rec) const;
+
+    bool occluded(const PrimitivePools& primitives,
+                  const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+
+    // Copies the bounds of refitted binary nodes into the child slots they occupy.
+    void refit(const BVH& bvh, const std::vector<uint32_t>& refitted);
+
+    // True if a wide node starts at binaryNode, so replaceSubtree can swap it out.
+    bool isSubtreeRoot(uint32_t binaryNode) const;
+
+    // Collapses the rebuilt binary subtree at binaryRoot, a subtree root other than the
+    // root, into new wide nodes and points its slot at them. The old wide nodes stay in
+    // nodes, unreachable, until the next full build.
+    void replaceSubtree(const BVH& bvh, uint32_t binaryRoot);
+
+private:
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    // Per binary node, the child slot it was collapsed into as node * WIDTH + slot, or
+    // NO_SLOT. Empty for BVHs loaded from a scene cache.
+    std::vector<uint32_t> binarySlots;
+
+    uint32_t collapse(const BVH& bvh, uint32_t binaryIndex, std::vector<WideBVHNode>& built);
+};
+
+#endif // WIDEBVH_H
@@ -1,20 +1,52 @@
 #include <SDL2/SDL.h>
+#include <chrono>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <memory>
+#include <omp.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Entity.h"
 #include "Scene.h"
 #include "Renderer.h"
+#include "RenderSession.h"
+#include "Constants.h"
+#include "RenderSettings.h"
 #include "SpectralData.h"
 #include "LambertianBSDF.h"
 #include "VulkanContext.h"
+#include "ImageIO.h"
+#include "MeshLoader.h"
+#include "SceneCache.h"
+
+// Axis-aligned box as an indexed mesh: 8 shared corners, two triangles per face.
+std::shared_ptr<TriangleMesh> createBox(const glm::vec3& min, const glm::vec3& max, uint32_t material) {
+    std::vector<glm::vec3> corners;
+    for (int i = 0; i < 8; i++)
+        corners.emplace_back(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+
+    std::vector<uint32_t> indices = {
+        0, 1, 4,  1, 5, 4,   // Bottom
+        2, 6, 3,  3, 6, 7,   // Top
+        4, 5, 6,  5, 7, 6,   // Front
+        0, 2, 1,  1, 2, 3,   // Back
+        0, 4, 2,  2, 4, 6,   // Left
+        1, 3, 5,  3, 7, 5    // Right
+    };
+    return std::make_shared<TriangleMesh>(std::move(corners), std::move(indices), material);
+}
 
-// Create a Cornell Box scene
-Scene createCornellBox() {
+// Create a Cornell Box scene. Colours go through spectra, which the caller shares with
+// the rest of the scene load.
+Scene createCornellBox(RGBSpectrumCache& spectra) {
     Scene scene;
 
+    const uint32_t white = scene.materials.add({ spectra.get(glm::vec3(0.8f, 0.8f, 0.8f)), Spectrum(0.0f) });
+    const uint32_t red = scene.materials.add({ spectra.get(glm::vec3(1.0f, 0.0f, 0.0f)), Spectrum(0.0f) });
+    const uint32_t green = scene.materials.add({ spectra.get(glm::vec3(0.0f, 1.0f, 0.0f)), Spectrum(0.0f) });
+    const uint32_t light = scene.materials.add({ spectra.get(glm::vec3(0.8f, 0.8f, 0.8f)), Spectrum(20.0f) });
+
     // Room dimensions
     float roomSize = 10.0f;
     float halfSize = roomSize / 2.0f;
@@ -24,15 +56,13 @@ Scene createCornellBox() {
         glm::vec3(-halfSize, -halfSize, -halfSize - roomSize),  // back left
         glm::vec3(halfSize, -halfSize, -halfSize - roomSize),   // back right
         glm::vec3(-halfSize, -halfSize, -halfSize),             // front left
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(0.0f)
+        white
     ));
     scene.addEntity(std::make_shared<Triangle>(
         glm::vec3(halfSize, -halfSize, -halfSize - roomSize),   // back right
         glm::vec3(halfSize, -halfSize, -halfSize),              // front right
         glm::vec3(-halfSize, -halfSize, -halfSize),             // front left
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(0.0f)
+        white
     ));
 
     // Ceiling (white)
@@ -40,15 +70,13 @@ Scene createCornellBox() {
         glm::vec3(-halfSize, halfSize, -halfSize - roomSize),   // back left
         glm::vec3(-halfSize, halfSize, -halfSize),              // front left
         glm::vec3(halfSize, halfSize, -halfSize - roomSize),    // back right
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(0.0f)
+        white
     ));
     scene.addEntity(std::make_shared<Triangle>(
         glm::vec3(halfSize, halfSize, -halfSize - roomSize),    // back right
         glm::vec3(-halfSize, halfSize, -halfSize),              // front left
         glm::vec3(halfSize, halfSize, -halfSize),               // front right
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(0.0f)
+        white
     ));
 
     // Back wall (white)
@@ -56,15 +84,13 @@ Scene createCornellBox() {
         glm::vec3(-halfSize, -halfSize, -halfSize - roomSize),  // bottom left
         glm::vec3(-halfSize, halfSize, -halfSize - roomSize),   // top left
         glm::vec3(halfSize, halfSize, -halfSize - roomSize),    // top right
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(0.0f)
+        white
     ));
     scene.addEntity(std::make_shared<Triangle>(
         glm::vec3(-halfSize, -halfSize, -halfSize - roomSize),  // bottom left
         glm::vec3(halfSize, halfSize, -halfSize - roomSize),    // top right
         glm::vec3(halfSize, -halfSize, -halfSize - roomSize),   // bottom right
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(0.0f)
+        white
     ));
 
     // Left wall (red)
@@ -72,15 +98,13 @@ Scene createCornellBox() {
         glm::vec3(-halfSize, -halfSize, -halfSize),             // front bottom
         glm::vec3(-halfSize, halfSize, -halfSize),              // front top
         glm::vec3(-halfSize, halfSize, -halfSize - roomSize),   // back top
-        Spectrum::fromRGB(glm::vec3(1.0f, 0.0f, 0.0f)),
-        Spectrum(0.0f)
+        red
     ));
     scene.addEntity(std::make_shared<Triangle>(
         glm::vec3(-halfSize, -halfSize, -halfSize),             // front bottom
         glm::vec3(-halfSize, halfSize, -halfSize - roomSize),   // back top
         glm::vec3(-halfSize, -halfSize, -halfSize - roomSize),  // back bottom
-        Spectrum::fromRGB(glm::vec3(1.0f, 0.0f, 0.0f)),
-        Spectrum(0.0f)
+        red
     ));
 
     // Right wall (green)
@@ -88,15 +112,13 @@ Scene createCornellBox() {
         glm::vec3(halfSize, -halfSize, -halfSize),              // front bottom
         glm::vec3(halfSize, -halfSize, -halfSize - roomSize),   // back bottom
         glm::vec3(halfSize, halfSize, -halfSize - roomSize),    // back top
-        Spectrum::fromRGB(glm::vec3(0.0f, 1.0f, 0.0f)),
-        Spectrum(0.0f)
+        green
     ));
     scene.addEntity(std::make_shared<Triangle>(
         glm::vec3(halfSize, -halfSize, -halfSize),              // front bottom
         glm::vec3(halfSize, halfSize, -halfSize - roomSize),    // back top
         glm::vec3(halfSize, halfSize, -halfSize),               // front top
-        Spectrum::fromRGB(glm::vec3(0.0f, 1.0f, 0.0f)),
-        Spectrum(0.0f)
+        green
     ));
 
     // Light source (bright white/yellow) - now using the emissive triangle method
@@ -107,16 +129,14 @@ Scene createCornellBox() {
         glm::vec3(-lightSize/2, lightY, -halfSize - roomSize/2 - lightSize/2),
         glm::vec3(-lightSize/2, lightY, -halfSize - roomSize/2 + lightSize/2),
         glm::vec3(lightSize/2, lightY, -halfSize - roomSize/2 - lightSize/2),
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(20.0f)
+        light
     ));
 
     scene.addEntity(std::make_shared<Triangle>(
         glm::vec3(lightSize/2, lightY, -halfSize - roomSize/2 - lightSize/2),
         glm::vec3(-lightSize/2, lightY, -halfSize - roomSize/2 + lightSize/2),
         glm::vec3(lightSize/2, lightY, -halfSize - roomSize/2 + lightSize/2),
-        Spectrum::fromRGB(glm::vec3(0.8f, 0.8f, 0.8f)),
-        Spectrum(20.0f)
+        light
     ));
 
     // Left box (tall)
@@ -125,106 +145,13 @@ Scene createCornellBox() {
     float tallBoxX = -halfSize/2 - tallBoxSize/2;
     float tallBoxZ = -halfSize - roomSize/2 - tallBoxSize/2;
     glm::vec3 tallBoxColor = glm::vec3(0.8f, 0.8f, 0.8f);
+    const uint32_t tallBox = scene.materials.add({ spectra.get(tallBoxColor), Spectrum(0.0f) });
 
     // Tall box - coordinates for a box
     glm::vec3 tallBoxMin(tallBoxX, -halfSize, tallBoxZ);
     glm::vec3 tallBoxMax(tallBoxX + tallBoxSize, -halfSize + tallBoxHeight, tallBoxZ + tallBoxSize);
 
-    // Tall box - Bottom face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Tall box - Top face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMin.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMax.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMin.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMin.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMax.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Tall box - Front face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMax.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Tall box - Back face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMin.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMin.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Tall box - Left face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMin.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMin.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMax.z),
-        glm::vec3(tallBoxMin.x, tallBoxMax.y, tallBoxMin.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Tall box - Right face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(tallBoxMax.x, tallBoxMin.y, tallBoxMax.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMin.z),
-        glm::vec3(tallBoxMax.x, tallBoxMax.y, tallBoxMax.z),
-        Spectrum::fromRGB(tallBoxColor),
-        Spectrum(0.0f)
-    ));
+    scene.addEntity(createBox(tallBoxMin, tallBoxMax, tallBox));
 
     // Short box (shorter cube)
     float shortBoxSize = 3.0f;
@@ -232,124 +159,351 @@ Scene createCornellBox() {
     float shortBoxX = halfSize/2 - shortBoxSize/2;
     float shortBoxZ = -halfSize - roomSize/2 + shortBoxSize/2;
     glm::vec3 shortBoxColor = glm::vec3(0.8f, 0.8f, 0.8f);
+    const uint32_t shortBox = scene.materials.add({ spectra.get(shortBoxColor), Spectrum(0.0f) });
 
     // Short box - coordinates for a box
     glm::vec3 shortBoxMin(shortBoxX, -halfSize, shortBoxZ);
     glm::vec3 shortBoxMax(shortBoxX + shortBoxSize, -halfSize + shortBoxHeight, shortBoxZ + shortBoxSize);
 
-    // Short box - Bottom face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Short box - Top face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMin.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMax.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMin.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMin.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMax.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Short box - Front face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-    // Short box - Front face (continued)
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMax.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Short box - Back face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMin.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMin.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Short box - Left face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMin.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMin.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMax.z),
-        glm::vec3(shortBoxMin.x, shortBoxMax.y, shortBoxMin.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-
-    // Short box - Right face
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
-    scene.addEntity(std::make_shared<Triangle>(
-        glm::vec3(shortBoxMax.x, shortBoxMin.y, shortBoxMax.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMin.z),
-        glm::vec3(shortBoxMax.x, shortBoxMax.y, shortBoxMax.z),
-        Spectrum::fromRGB(shortBoxColor),
-        Spectrum(0.0f)
-    ));
+    scene.addEntity(createBox(shortBoxMin, shortBoxMax, shortBox));
 
     // Create an instance of a Lambertian BSDF with a diffuse red color.
-     BSDF* bsdf_lamb = new LambertianBSDF(Spectrum::fromRGB(glm::vec3(1.0f, 0.0f, 0.0f)));
+     BSDF* bsdf_lamb = new LambertianBSDF(spectra.get(glm::vec3(1.0f, 0.0f, 0.0f)));
 
      // Then add the sphere to the scene using the BSDF pointer.
+     const uint32_t pink = scene.materials.add({
+         spectra.get(glm::vec3(251.0f/256.0f, 198.0f/256.0f, 207.0f/256.0f)),
+         Spectrum(0.0f),
+         bsdf_lamb
+     });
      scene.addEntity(std::make_shared<Sphere>(
          glm::vec3(0.0f, 0.0f, -halfSize - roomSize / 2),
          1.0,
-         Spectrum::fromRGB(glm::vec3(251.0f/256.0f, 198.0f/256.0f, 207.0f/256.0f)),
-         Spectrum(0.0f),
-         bsdf_lamb
+         pink
      ));
 
     return scene;
 }
 
-int main() {
+// Fixed camera position to view the Cornell Box
+Camera createCornellCamera() {
+    glm::vec3 camPos(0.0f, 0.0f, 5.0f);
+    glm::vec3 target(0.0f, 0.0f, -15.0f);  // Look toward the center of the room
+    glm::vec3 worldUp(0.0f, 1.0f, 0.0f);
+    return Camera::lookAt(camPos, target, worldUp);
+}
+
+struct Options {
+    bool headless = false;
+    std::string scene = "cornell";
+    std::string mesh;                   // Optional OBJ/PLY file placed in the scene
+    std::string spheres;                // Optional XYZR sphere file placed in the scene
+    RenderSettings settings;
+    int threads = 0;                    // 0 keeps the OpenMP default
+    std::string output = "render.ppm";
+    std::string cacheDir = "scene-cache";   // Empty disables the scene cache
+};
+
+void printUsage(const char* program) {
+    const RenderSettings defaults;
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --headless         Render once without a window and write the image to disk\n"
+              << "  --scene <name>     Scene to render (default: cornell)\n"
+              << "  --mesh <file>      OBJ or binary PLY mesh to place on the floor of the scene\n"
+              << "  --spheres <file>   XYZR sphere list (x y z radius per line) to place on the floor of the scene\n"
+              << "  --width <pixels>   Image width (default: " << defaults.width << ")\n"
+              << "  --height <pixels>  Image height (default: " << defaults.height << ")\n"
+              << "  --spp <samples>    Samples per pixel for headless renders (default: " << defaults.samplesPerPixel << ")\n"
+              << "  --min-depth <n>    Bounces before Russian roulette may end a path (default: " << defaults.minDepth << ")\n"
+              << "  --max-depth <n>    Maximum path length (default: " << defaults.maxDepth << ")\n"
+              << "  --fov <degrees>    Vertical field of view (default: " << glm::degrees(defaults.fov) << ")\n"
+              << "  --hero             Trace " << HERO_WAVELENGTHS << " hero wavelengths per path instead of the full spectrum\n"
+              << "  --light-bvh        Pick shadow ray lights by power and distance instead of power alone\n"
+              << "  --threads <count>  Number of render threads (default: all cores)\n"
+              << "  --output <path>    Output PPM file for headless renders (default: render.ppm)\n"
+              << "  --cache-dir <dir>  Directory of built scene caches (default: scene-cache)\n"
+              << "  --no-cache         Always build the scene and BVH, without reading or writing a cache\n";
+}
+
+bool parseArguments(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+            continue;
+        }
+        if (arg == "--hero") {
+            options.settings.heroWavelengths = true;
+            continue;
+        }
+        if (arg == "--light-bvh") {
+            options.settings.lightBVH = true;
+            continue;
+        }
+        if (arg == "--no-cache") {
+            options.cacheDir.clear();
+            continue;
+        }
+        if (arg == "--help" || arg == "-h")
+            return false;
+
+        if (arg != "--scene" && arg != "--mesh" && arg != "--spheres" && arg != "--output" && arg != "--width" && arg != "--height" &&
+            arg != "--spp" && arg != "--min-depth" && arg != "--max-depth" && arg != "--fov" && arg != "--threads" && arg != "--cache-dir") {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+
+        try {
+            if (arg == "--scene") {
+                options.scene = value;
+            } else if (arg == "--mesh") {
+                options.mesh = value;
+            } else if (arg == "--spheres") {
+                options.spheres = value;
+            } else if (arg == "--output") {
+                options.output = value;
+            } else if (arg == "--cache-dir") {
+                options.cacheDir = value;
+            } else if (arg == "--width") {
+                options.settings.width = std::stoi(value);
+            } else if (arg == "--height") {
+                options.settings.height = std::stoi(value);
+            } else if (arg == "--spp") {
+                options.settings.samplesPerPixel = std::stoi(value);
+            } else if (arg == "--min-depth") {
+                options.settings.minDepth = std::stoi(value);
+            } else if (arg == "--max-depth") {
+                options.settings.maxDepth = std::stoi(value);
+            } else if (arg == "--fov") {
+                options.settings.fov = glm::radians(std::stof(value));
+            } else {
+                options.threads = std::stoi(value);
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+            return false;
+        }
+    }
+
+    const RenderSettings& settings = options.settings;
+    if (settings.width <= 0 || settings.height <= 0 || settings.samplesPerPixel <= 0 ||
+        settings.minDepth < 0 || settings.maxDepth < 0 || options.threads < 0) {
+        std::cerr << "Width, height and spp must be positive, depths and threads non-negative\n";
+        return false;
+    }
+    if (settings.minDepth > settings.maxDepth) {
+        std::cerr << "Min depth must not exceed max depth\n";
+        return false;
+    }
+    if (settings.fov <= 0.0f || settings.fov >= glm::radians(180.0f)) {
+        std::cerr << "Field of view must be between 0 and 180 degrees\n";
+        return false;
+    }
+    return true;
+}
+
+// Moves loaded geometry onto the floor of the Cornell box, centered and scaled to fit a
+// 4 unit cube.
+struct FloorPlacement {
+    glm::vec3 anchor;
+    float scale;
+
+    explicit FloorPlacement(const AABB& bounds)
+        : anchor((bounds.min.x + bounds.max.x) * 0.5f, bounds.min.y, (bounds.min.z + bounds.max.z) * 0.5f) {
+        scale = 4.0f / maxExtent(bounds);
+    }
+
+    // Geometry with no extent, such as a single point, cannot be scaled to fit.
+    static float maxExtent(const AABB& bounds) {
+        glm::vec3 extent = bounds.extent();
+        return std::max(extent.x, std::max(extent.y, extent.z));
+    }
+
+    glm::vec3 apply(const glm::vec3& p) const {
+        const glm::vec3 floorCenter(0.0f, -5.0f, -10.0f);
+        return (p - anchor) * scale + floorCenter;
+    }
+};
+
+// Loads a mesh file and places it on the floor of the Cornell box, scaled to fit
+// a 4 unit cube.
+bool addMeshToScene(const std::string& path, uint32_t material, Scene& scene) {
+    auto start = std::chrono::steady_clock::now();
+    MeshData data;
+    if (!loadMesh(path, data))
+        return false;
+    if (data.positions.empty() || data.indices.empty()) {
+        std::cerr << "Mesh " << path << " has no triangles\n";
+        return false;
+    }
+
+    AABB bounds;
+    for (const glm::vec3& p : data.positions)
+        bounds.expand(p);
+    if (!(FloorPlacement::maxExtent(bounds) > 0.0f)) {
+        std::cerr << "Mesh " << path << " has no extent\n";
+        return false;
+    }
+    const FloorPlacement placement(bounds);
+    for (glm::vec3& p : data.positions)
+        p = placement.apply(p);
+
+    auto mesh = std::make_shared<TriangleMesh>(std::move(data.positions), std::move(data.indices), material,
+                                               std::move(data.normals), std::move(data.uvs));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded " << path << ": " << mesh->positions.size() << " vertices, "
+              << mesh->triangleCount() << " triangles in " << seconds << " s\n";
+    scene.addEntity(mesh);
+    return true;
+}
+
+// Loads a sphere file and places it on the floor of the Cornell box like a mesh.
+bool addSpheresToScene(const std::string& path, uint32_t material, Scene& scene) {
+    auto start = std::chrono::steady_clock::now();
+    SphereData data;
+    if (!loadSpheres(path, data))
+        return false;
+    if (data.centers.empty()) {
+        std::cerr << "Sphere file " << path << " has no spheres\n";
+        return false;
+    }
+
+    AABB bounds;
+    for (size_t i = 0; i < data.centers.size(); i++) {
+        bounds.expand(data.centers[i] - glm::vec3(data.radii[i]));
+        bounds.expand(data.centers[i] + glm::vec3(data.radii[i]));
+    }
+    if (!(FloorPlacement::maxExtent(bounds) > 0.0f)) {
+        std::cerr << "Sphere file " << path << " has no extent\n";
+        return false;
+    }
+    const FloorPlacement placement(bounds);
+    for (glm::vec3& c : data.centers)
+        c = placement.apply(c);
+    for (float& r : data.radii)
+        r *= placement.scale;
+
+    auto spheres = std::make_shared<SphereSet>(std::move(data.centers), std::move(data.radii), material);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Loaded " << path << ": " << spheres->sphereCount() << " spheres in " << seconds << " s\n";
+    scene.addEntity(spheres);
+    return true;
+}
+
+bool loadScene(const Options& options, Scene& scene) {
+    if (options.scene != "cornell") {
+        std::cerr << "Unknown scene " << options.scene << "\n";
+        return false;
+    }
+    RGBSpectrumCache spectra;
+    scene = createCornellBox(spectra);
+
+    // The mesh and sphere materials go into the table before the files are loaded, so a
+    // cache hit sees the same table without reading them.
+    std::vector<std::string> inputFiles;
+    uint32_t meshMaterial = 0;
+    if (!options.mesh.empty()) {
+        meshMaterial = scene.materials.add({ spectra.get(glm::vec3(0.8f, 0.8f, 0.8f)), Spectrum(0.0f) });
+        inputFiles.push_back(options.mesh);
+    }
+    uint32_t sphereMaterial = 0;
+    if (!options.spheres.empty()) {
+        sphereMaterial = scene.materials.add({ spectra.get(glm::vec3(0.8f, 0.8f, 0.8f)), Spectrum(0.0f) });
+        inputFiles.push_back(options.spheres);
+    }
+
+    uint64_t key = 0;
+    std::string cachePath;
+    if (!options.cacheDir.empty()) {
+        scene.collectPrimitives();
+        key = hashSceneInput(scene, inputFiles);
+        cachePath = sceneCachePath(options.cacheDir, key);
+        if (loadSceneCache(cachePath, key, scene)) {
+            std::cout << "Mapped scene cache " << cachePath << "\n";
+            return true;
+        }
+    }
+
+    if (!options.mesh.empty() && !addMeshToScene(options.mesh, meshMaterial, scene))
+        return false;
+    if (!options.spheres.empty() && !addSpheresToScene(options.spheres, sphereMaterial, scene))
+        return false;
+    scene.buildBVH();
+    if (!cachePath.empty() && writeSceneCache(cachePath, key, scene))
+        std::cout << "Wrote scene cache " << cachePath << "\n";
+    return true;
+}
+
+void printBVHStats(const Scene& scene) {
+    std::cout << "Scene: " << scene.entities.size() << " entities, "
+              << scene.materials.size() << " materials, " << scene.lights.size() << " lights\n";
+    std::cout << "BVH: " << scene.bvh->stats.nodeCount << " nodes, "
+              << scene.bvh->stats.leafCount << " leaves, depth " << scene.bvh->stats.maxDepth
+              << ", SAH cost " << scene.bvh->stats.sahCost
+              << ", built in " << scene.bvh->stats.buildTimeMs << " ms, "
+              << scene.wideBVH->nodes.size() << " BVH8 nodes\n";
+}
+
+// Renders one image on the CPU and writes it to disk. No SDL or Vulkan involved.
+int runHeadless(const Options& options) {
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+
+    Scene scene;
+    if (!loadScene(options, scene))
+        return -1;
+    printBVHStats(scene);
+    auto sceneReady = Clock::now();
+
+    const RenderSettings& settings = options.settings;
+    std::vector<uint32_t> pixels(static_cast<size_t>(settings.width) * settings.height);
+    RenderSession session(settings);
+    session.setCamera(createCornellCamera());
+    session.renderFrame(scene, settings.samplesPerPixel);
+    session.resolve(pixels.data());
+    auto renderDone = Clock::now();
+
+    if (!writePPM(options.output, pixels.data(), settings.width, settings.height)) {
+        std::cerr << "Failed to write " << options.output << "\n";
+        return -1;
+    }
+    auto end = Clock::now();
+
+    double sceneSeconds = std::chrono::duration<double>(sceneReady - start).count();
+    double renderSeconds = std::chrono::duration<double>(renderDone - sceneReady).count();
+    double totalSeconds = std::chrono::duration<double>(end - start).count();
+    double samples = static_cast<double>(settings.width) * settings.height * settings.samplesPerPixel;
+
+    std::cout << "Rendered " << options.scene << " at " << settings.width << "x" << settings.height
+              << ", " << settings.samplesPerPixel << " spp, depth " << settings.maxDepth
+              << (settings.heroWavelengths ? ", hero wavelengths" : ", full spectrum")
+              << (settings.wavefront ? ", wavefront" : "")
+              << " on " << omp_get_max_threads() << " threads\n"
+              << "  scene + BVH: " << sceneSeconds << " s\n"
+              << "  render:      " << renderSeconds << " s (" << samples / renderSeconds / 1e6 << " Msamples/s)\n"
+              << "  total:       " << totalSeconds << " s\n"
+              << "Wrote " << options.output << "\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    if (options.threads > 0)
+        omp_set_num_threads(options.threads);
+
+    if (options.headless)
+        return runHeadless(options);
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         std::cerr << "SDL Init failed: " << SDL_GetError() << "\n";
         return -1;
@@ -359,7 +513,7 @@ int main() {
     SDL_Window* window = SDL_CreateWindow("Monte Carlo Path tracing Spectral Rendering",
                                           SDL_WINDOWPOS_CENTERED,
                                           SDL_WINDOWPOS_CENTERED,
-                                          Renderer::WIDTH, Renderer::HEIGHT,
+                                          options.settings.width, options.settings.height,
                                           SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN);
     if (!window) {
         std::cerr << "Window creation failed: " << SDL_GetError() << "\n";
@@ -383,11 +537,19 @@ int main() {
     }
 
     SDL_Surface* surface = SDL_GetWindowSurface(window);
-    std::vector<uint32_t> pixels(Renderer::WIDTH * Renderer::HEIGHT);
+    std::vector<uint32_t> pixels(static_cast<size_t>(options.settings.width) * options.settings.height);
 
     // Create the scene and build BVH
-    Scene scene = createCornellBox();
-    scene.buildBVH();
+    Scene scene;
+    if (!loadScene(options, scene)) {
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return -1;
+    }
+    printBVHStats(scene);
+
+    // Accumulates samples across frames while the view stays the same.
+    RenderSession session(options.settings);
 
     bool running = true;
     SDL_Event event;
@@ -396,19 +558,20 @@ int main() {
             if (event.type == SDL_QUIT)
                 running = false;
 
-        // Fixed camera position to view the Cornell Box
-        glm::vec3 camPos(0.0f, 0.0f, 5.0f);
-        glm::vec3 target(0.0f, 0.0f, -15.0f);  // Look toward the center of the room
-        glm::vec3 forward = glm::normalize(target - camPos);
-        glm::vec3 worldUp(0.0f, 1.0f, 0.0f);
-        glm::vec3 right = glm::normalize(glm::cross(forward, worldUp));
-        glm::vec3 up = glm::normalize(glm::cross(right, forward));
+        session.setCamera(createCornellCamera());
 
         // TODO: Replace with Vulkan rendering when ready asdf
-        Renderer::renderImage(pixels.data(), scene, camPos, forward, right, up);
+        if (session.getSampleCount() < maxProgressiveSamples) {
+            session.renderFrame(scene, options.settings.samplesPerFrame);
+            session.resolve(pixels.data());
+        }
 
+        // Rows of the surface may be padded past the image width, so copy one row at a time.
         SDL_LockSurface(surface);
-        memcpy(surface->pixels, pixels.data(), Renderer::WIDTH * Renderer::HEIGHT * sizeof(uint32_t));
+        const size_t rowBytes = static_cast<size_t>(options.settings.width) * sizeof(uint32_t);
+        for (int y = 0; y < options.settings.height; y++)
+            memcpy(static_cast<uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch,
+                   pixels.data() + static_cast<size_t>(y) * options.settings.width, rowBytes);
         SDL_UnlockSurface(surface);
         SDL_UpdateWindowSurface(window);
 
@@ -421,4 +584,3 @@ int main() {
     SDL_Quit();
     return 0;
 }
-